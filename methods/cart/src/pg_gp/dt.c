@@ -103,6 +103,12 @@ static float8 DT_CONFIDENCE_DEV[]   =
 #define MIN_DT_CONFIDENCE_LEVEL 0.001
 #define MAX_DT_CONFIDENCE_LEVEL 100.0
 
+/*
+ * The largest expected bootstrap weight. The inversion of the Poisson CDF
+ * starts from exp(-lambda), which must not underflow.
+ */
+#define MAX_DT_POISSON_LAMBDA 700.0
+
 
 #define dt_check_error_value(condition, message, value) \
 			do { \
@@ -1164,132 +1170,36 @@ PG_FUNCTION_INFO_V1(dt_best_scv_prefunc);
 
 
 /*
- * @brief The step function for the aggregation of SCV.
- *        It accumulates all the information for SCV calculation
- *        and stores to a nine-element array.
- *
- * @param scv_state_array   The array used to accumulate all the information
- *                          for the calculation of SCV.
- *                          Please refer to the definition of 
- *                          DT_SCV_STATE_ARRAY_INDEX.
- * @param sc_code           1- infogain; 2- gainratio; 3- gini.
- * @param feature_val       The feature value of current record under processing.
- * @param class             The class of current record under processing.
- * @param is_cont_feature   True  - The feature is continuous. 
+ * @brief Accumulate the contribution of one ACS record into the state of the
+ *        SCV aggregation. It is shared by the step function of __scv_aggr
+ *        and the histogram based split finder.
+ *
+ * @param scv_state_data    The nine-element state. Please refer to the
+ *                          definition of DT_SCV_STATE_ARRAY_INDEX.
+ * @param sc_type           1- infogain; 2- gainratio; 3- gini.
+ * @param is_cont_feat      True  - The feature is continuous.
  *                          False - The feature is discrete.
- * @param le                The le component of an ACS record.
- * @param total             The total component of an ACS record.
- * @param true_total_count  If there is any missing value, true_total_count is larger
- *      				    than the total count computed in the aggregation. Thus,
- *                          we should multiply a ratio for the computed gain.
+ * @param num_class         The total number of classes.
+ * @param le_data           The le component of the ACS record.
+ * @param total_data        The total component of the ACS record.
  *
- * @return A nine-element array. Please refer to the definition of 
- *         DT_SCV_STATE_ARRAY_INDEX for the detailed information of this array.
  */
-Datum
-dt_scv_aggr_sfunc
+static
+void
+dt_scv_accumulate
 	(
-	PG_FUNCTION_ARGS
+	float8          *scv_state_data,
+	int             sc_type,
+	bool            is_cont_feat,
+	int             num_class,
+	const float8    *le_data,
+	const float8    *total_data
 	)
 {
-    ArrayType*	scv_state_array	= NULL;
-    if (fcinfo->context && IsA(fcinfo->context, AggState))
-        scv_state_array = PG_GETARG_ARRAYTYPE_P(0);
-    else
-        scv_state_array = PG_GETARG_ARRAYTYPE_P_COPY(0);
-
-	dt_check_error
-		(
-			scv_state_array,
-			"invalid aggregation state array"
-		);
-
-    dt_check_error
-        (
-            !ARR_HASNULL(scv_state_array),
-            "the first array passed to dt_scv_aggr_sfunc cannot contain NULL values"
-        );
-
-    int	 array_dim 		= ARR_NDIM(scv_state_array);
-
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of scv state array must be equal to 1",
-			array_dim
-		);
-
-    int* p_array_dim	= ARR_DIMS(scv_state_array);
-    int  array_length	= ArrayGetNItems(array_dim, p_array_dim);
-
-    dt_check_error_value
-		(
-			array_length == SCV_MAX_CLASS_COUNT + 1,
-			"dt_scv_aggr_sfunc invalid array length: %d",
-			array_length
-		);
-
-    float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
-	dt_check_error
-		(
-			scv_state_data,
-			"invalid aggregation data array"
-		);
-
-    int sc_type	        = PG_GETARG_INT32(1);
-    bool is_cont_feat 	= PG_ARGISNULL(2) ? 0 : PG_GETARG_BOOL(2);
-    int num_class     	= PG_ARGISNULL(3) ? 0 : PG_GETARG_INT32(3);
-    
-    // we only read the data from le-array and total-array 
-    ArrayType* le_array =  PG_GETARG_ARRAYTYPE_P(4);
-    dt_check_error(le_array, "invalid le array");
-    array_dim 	    	= ARR_NDIM(le_array);
-    dt_check_error(array_dim == 1, "the dimemsion of le array must be 1");
-    p_array_dim	        = ARR_DIMS(le_array);
-    array_length	    = ArrayGetNItems(array_dim, p_array_dim);
-    dt_check_error
-        (
-            array_length == num_class, 
-            "the size of le array must be the number of class"
-        );
-    float8* le_data     = (float8 *)ARR_DATA_PTR(le_array);
-    
-    // total array
-    ArrayType* total_array  =  PG_GETARG_ARRAYTYPE_P(5);
-    dt_check_error(total_array, "invalid total array");
-    array_dim 	    	    = ARR_NDIM(total_array);
-    dt_check_error(array_dim == 1, "the dimemsion of total array must be 1");
-    p_array_dim	            = ARR_DIMS(total_array);
-    array_length	        = ArrayGetNItems(array_dim, p_array_dim);
-    dt_check_error
-        (
-            array_length == num_class, 
-            "the size of total array must be the number of class"
-        );
-    float8* total_data  = (float8 *)ARR_DATA_PTR(total_array);
-
     int i               = 0;
     float8 feat_le      = 0.0;
     float8 feat_cnts    = 0.0;
 
-	dt_check_error_value
-		(
-			DT_SC_INFOGAIN  == sc_type ||
-			DT_SC_GAINRATIO == sc_type ||
-			DT_SC_GINI      == sc_type,
-			"invalid split criterion: %d. "
-			"It must be 1(infogain), 2(gainratio) or 3(gini)",
-			sc_type
-		);
-    
-    scv_state_data[SCV_CODE] 		    = sc_type;
-    scv_state_data[SCV_SAMPLE_TOTAL]    = PG_ARGISNULL(6) ? 0 : PG_GETARG_INT64(6);
-    scv_state_data[SCV_IS_CONT]         = is_cont_feat;
-
-    dtelog(NOTICE, "array: %lf, %lf, %lf, %lf", 
-       le_data[0], le_data[1], total_data[0], total_data[1]);
-
     // processing the continuous feature
     if (is_cont_feat)
     {
@@ -1455,30 +1365,107 @@ dt_scv_aggr_sfunc
             }
         }
     }
-    dtelog(NOTICE, "data: %lf, %lf, %lf, %lf", 
-        scv_state_data[SCV_W], 
-        scv_state_data[SCV_U],
-        scv_state_data[SCV_V],
-        scv_state_data[SCV_T]);
+}
 
-    PG_RETURN_ARRAYTYPE_P(scv_state_array);
+
+/*
+ * @brief Compute the five-element SCV result from the state of the SCV
+ *        aggregation.
+ *
+ * @param scv_state_data    The nine-element state. Please refer to the
+ *                          definition of DT_SCV_STATE_ARRAY_INDEX.
+ * @param result            The five-element result. Please refer to the
+ *                          definition of DT_SCV_FINAL_ARRAY_INDEX.
+ *
+ */
+static
+void
+dt_scv_finalize
+	(
+	float8  *scv_state_data,
+	float8  *result
+	)
+{
+    float8 tmp      = 0.0;
+
+    /* If true total count is 0/null, there is no missing values*/
+    if (dt_is_float_zero(scv_state_data[SCV_SAMPLE_TOTAL]))
+    {
+        scv_state_data[SCV_SAMPLE_TOTAL] =
+        		scv_state_data[SCV_T];
+    }
+
+    /* true total count should be greater than 0*/
+    dt_check_error
+    	(
+    		scv_state_data[SCV_SAMPLE_TOTAL] > 0 && scv_state_data[SCV_T] > 0,
+    		"true total count should be greater than 0"
+    	);
+
+    /* 
+     * For the following elements, such as max class id, we should copy
+     * them from step function array to final function array for returning.
+     */
+    result[SCV_FINAL_CLASS_ID]	    = scv_state_data[SCV_MAX_CLASS_ID];
+    result[SCV_FINAL_IS_CONT]   	= scv_state_data[SCV_IS_CONT];
+    result[SCV_FINAL_TOTAL_COUNT]   = scv_state_data[SCV_SAMPLE_TOTAL];
+    result[SCV_FINAL_CLASS_PROB]    = 
+        scv_state_data[SCV_MAX_CLASS_COUNT] / scv_state_data[SCV_SAMPLE_TOTAL];
+
+
+    if (DT_SC_INFOGAIN == ((int)scv_state_data[SCV_CODE]))
+    {
+        // info gain
+        result[SCV_FINAL_VALUE] = 
+            log(scv_state_data[SCV_T]) - 
+             ((scv_state_data[SCV_U] + scv_state_data[SCV_V] -
+              scv_state_data[SCV_W]) / scv_state_data[SCV_T]);
+    }
+    else if (DT_SC_GAINRATIO == ((int)scv_state_data[SCV_CODE]))
+    {
+        // gain ratio
+        tmp = dt_cal_log(scv_state_data[SCV_T]) - scv_state_data[SCV_V];
+        result[SCV_FINAL_VALUE] = dt_is_float_zero(tmp) ? 0.0 :
+            1 + (scv_state_data[SCV_W] - scv_state_data[SCV_U]) / tmp;
+    }
+    else
+    {
+        //gini index
+        result[SCV_FINAL_VALUE] = 
+            (scv_state_data[SCV_W] / scv_state_data[SCV_T]) -
+            (scv_state_data[SCV_U]) / dt_cal_sqr(scv_state_data[SCV_T]);
+    }
+    
+    result[SCV_FINAL_VALUE] *= (scv_state_data[SCV_T] / 
+            scv_state_data[SCV_SAMPLE_TOTAL]); 
 }
-PG_FUNCTION_INFO_V1(dt_scv_aggr_sfunc);
 
 
 /*
- * @brief   The pre-function for the aggregation of SCV. It takes the state 
- *          array produced by two sfunc and combine them together.
+ * @brief The step function for the aggregation of SCV.
+ *        It accumulates all the information for SCV calculation
+ *        and stores to a nine-element array.
  *
- * @param scv_state_array    The array from sfunc1.
- * @param scv_state_array    The array from sfunc2.
+ * @param scv_state_array   The array used to accumulate all the information
+ *                          for the calculation of SCV.
+ *                          Please refer to the definition of 
+ *                          DT_SCV_STATE_ARRAY_INDEX.
+ * @param sc_code           1- infogain; 2- gainratio; 3- gini.
+ * @param feature_val       The feature value of current record under processing.
+ * @param class             The class of current record under processing.
+ * @param is_cont_feature   True  - The feature is continuous. 
+ *                          False - The feature is discrete.
+ * @param le                The le component of an ACS record.
+ * @param total             The total component of an ACS record.
+ * @param true_total_count  If there is any missing value, true_total_count is larger
+ *      				    than the total count computed in the aggregation. Thus,
+ *                          we should multiply a ratio for the computed gain.
  *
  * @return A nine-element array. Please refer to the definition of 
  *         DT_SCV_STATE_ARRAY_INDEX for the detailed information of this array.
- *
  */
 Datum
-dt_scv_aggr_prefunc
+dt_scv_aggr_sfunc
 	(
 	PG_FUNCTION_ARGS
 	)
@@ -1498,10 +1485,11 @@ dt_scv_aggr_prefunc
     dt_check_error
         (
             !ARR_HASNULL(scv_state_array),
-            "the first array passed to dt_scv_aggr_prefunc cannot contain NULL values"
+            "the first array passed to dt_scv_aggr_sfunc cannot contain NULL values"
         );
 
-    int array_dim 		= ARR_NDIM(scv_state_array);
+    int	 array_dim 		= ARR_NDIM(scv_state_array);
+
     dt_check_error_value
 		(
 			array_dim == 1,
@@ -1510,43 +1498,174 @@ dt_scv_aggr_prefunc
 			array_dim
 		);
 
-    int *p_array_dim 	= ARR_DIMS(scv_state_array);
-    int array_length 	= ArrayGetNItems(array_dim, p_array_dim);
+    int* p_array_dim	= ARR_DIMS(scv_state_array);
+    int  array_length	= ArrayGetNItems(array_dim, p_array_dim);
+
     dt_check_error_value
 		(
 			array_length == SCV_MAX_CLASS_COUNT + 1,
-			"dt_scv_aggr_prefunc invalid array length: %d",
+			"dt_scv_aggr_sfunc invalid array length: %d",
 			array_length
 		);
 
-    /* the scv state data from a segment */
     float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
 	dt_check_error
 		(
 			scv_state_data,
 			"invalid aggregation data array"
-		);    
-
-    ArrayType* scv_state_array2	= PG_GETARG_ARRAYTYPE_P(1);
-	dt_check_error
-		(
-			scv_state_array2,
-			"invalid aggregation state array"
 		);
 
+    int sc_type	        = PG_GETARG_INT32(1);
+    bool is_cont_feat 	= PG_ARGISNULL(2) ? 0 : PG_GETARG_BOOL(2);
+    int num_class     	= PG_ARGISNULL(3) ? 0 : PG_GETARG_INT32(3);
+    
+    // we only read the data from le-array and total-array 
+    ArrayType* le_array =  PG_GETARG_ARRAYTYPE_P(4);
+    dt_check_error(le_array, "invalid le array");
+    array_dim 	    	= ARR_NDIM(le_array);
+    dt_check_error(array_dim == 1, "the dimemsion of le array must be 1");
+    p_array_dim	        = ARR_DIMS(le_array);
+    array_length	    = ArrayGetNItems(array_dim, p_array_dim);
     dt_check_error
         (
-            !ARR_HASNULL(scv_state_array2),
-            "the second array passed to dt_scv_aggr_prefunc cannot contain NULL values"
+            array_length == num_class, 
+            "the size of le array must be the number of class"
         );
-
-    array_dim 		= ARR_NDIM(scv_state_array2);
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of scv state array must be equal to 1",
-			array_dim
+    float8* le_data     = (float8 *)ARR_DATA_PTR(le_array);
+    
+    // total array
+    ArrayType* total_array  =  PG_GETARG_ARRAYTYPE_P(5);
+    dt_check_error(total_array, "invalid total array");
+    array_dim 	    	    = ARR_NDIM(total_array);
+    dt_check_error(array_dim == 1, "the dimemsion of total array must be 1");
+    p_array_dim	            = ARR_DIMS(total_array);
+    array_length	        = ArrayGetNItems(array_dim, p_array_dim);
+    dt_check_error
+        (
+            array_length == num_class, 
+            "the size of total array must be the number of class"
+        );
+    float8* total_data  = (float8 *)ARR_DATA_PTR(total_array);
+
+	dt_check_error_value
+		(
+			DT_SC_INFOGAIN  == sc_type ||
+			DT_SC_GAINRATIO == sc_type ||
+			DT_SC_GINI      == sc_type,
+			"invalid split criterion: %d. "
+			"It must be 1(infogain), 2(gainratio) or 3(gini)",
+			sc_type
+		);
+    
+    scv_state_data[SCV_CODE] 		    = sc_type;
+    scv_state_data[SCV_SAMPLE_TOTAL]    = PG_ARGISNULL(6) ? 0 : PG_GETARG_INT64(6);
+    scv_state_data[SCV_IS_CONT]         = is_cont_feat;
+
+    dtelog(NOTICE, "array: %lf, %lf, %lf, %lf", 
+       le_data[0], le_data[1], total_data[0], total_data[1]);
+
+    dt_scv_accumulate
+        (
+            scv_state_data,
+            sc_type,
+            is_cont_feat,
+            num_class,
+            le_data,
+            total_data
+        );
+
+    dtelog(NOTICE, "data: %lf, %lf, %lf, %lf", 
+        scv_state_data[SCV_W], 
+        scv_state_data[SCV_U],
+        scv_state_data[SCV_V],
+        scv_state_data[SCV_T]);
+
+    PG_RETURN_ARRAYTYPE_P(scv_state_array);
+}
+PG_FUNCTION_INFO_V1(dt_scv_aggr_sfunc);
+
+
+/*
+ * @brief   The pre-function for the aggregation of SCV. It takes the state 
+ *          array produced by two sfunc and combine them together.
+ *
+ * @param scv_state_array    The array from sfunc1.
+ * @param scv_state_array    The array from sfunc2.
+ *
+ * @return A nine-element array. Please refer to the definition of 
+ *         DT_SCV_STATE_ARRAY_INDEX for the detailed information of this array.
+ *
+ */
+Datum
+dt_scv_aggr_prefunc
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+    ArrayType*	scv_state_array	= NULL;
+    if (fcinfo->context && IsA(fcinfo->context, AggState))
+        scv_state_array = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        scv_state_array = PG_GETARG_ARRAYTYPE_P_COPY(0);
+
+	dt_check_error
+		(
+			scv_state_array,
+			"invalid aggregation state array"
+		);
+
+    dt_check_error
+        (
+            !ARR_HASNULL(scv_state_array),
+            "the first array passed to dt_scv_aggr_prefunc cannot contain NULL values"
+        );
+
+    int array_dim 		= ARR_NDIM(scv_state_array);
+    dt_check_error_value
+		(
+			array_dim == 1,
+			"invalid array dimension: %d. "
+			"The dimension of scv state array must be equal to 1",
+			array_dim
+		);
+
+    int *p_array_dim 	= ARR_DIMS(scv_state_array);
+    int array_length 	= ArrayGetNItems(array_dim, p_array_dim);
+    dt_check_error_value
+		(
+			array_length == SCV_MAX_CLASS_COUNT + 1,
+			"dt_scv_aggr_prefunc invalid array length: %d",
+			array_length
+		);
+
+    /* the scv state data from a segment */
+    float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
+	dt_check_error
+		(
+			scv_state_data,
+			"invalid aggregation data array"
+		);    
+
+    ArrayType* scv_state_array2	= PG_GETARG_ARRAYTYPE_P(1);
+	dt_check_error
+		(
+			scv_state_array2,
+			"invalid aggregation state array"
+		);
+
+    dt_check_error
+        (
+            !ARR_HASNULL(scv_state_array2),
+            "the second array passed to dt_scv_aggr_prefunc cannot contain NULL values"
+        );
+
+    array_dim 		= ARR_NDIM(scv_state_array2);
+    dt_check_error_value
+		(
+			array_dim == 1,
+			"invalid array dimension: %d. "
+			"The dimension of scv state array must be equal to 1",
+			array_dim
 		);    
     p_array_dim 	= ARR_DIMS(scv_state_array2);
     array_length 	= ArrayGetNItems(array_dim, p_array_dim);
@@ -1666,65 +1785,504 @@ dt_scv_aggr_ffunc
 
     int result_size	= SCV_FINAL_TOTAL_COUNT + 1;
     float8 *result	= palloc0(sizeof(float8) * result_size);
-    float8 tmp      = 0.0;
 
     dtelog( NOTICE, 
             "total:%lf, %lf",
             scv_state_data[SCV_SAMPLE_TOTAL], 
             scv_state_data[SCV_T]);
 
-    /* If true total count is 0/null, there is no missing values*/
-    if (dt_is_float_zero(scv_state_data[SCV_SAMPLE_TOTAL]))
+    dt_scv_finalize(scv_state_data, result);
+
+    dtelog(NOTICE, "final value: %lf", result[SCV_FINAL_VALUE]);
+
+    ArrayType* result_array =
+        construct_array(
+            (Datum *)result,
+            result_size,
+            FLOAT8OID,
+            sizeof(float8),
+            true,
+            'd'
+            );
+
+    PG_RETURN_ARRAYTYPE_P(result_array);
+}
+PG_FUNCTION_INFO_V1(dt_scv_aggr_ffunc);
+
+
+/*
+ * The histogram based split finder replaces the window function and the
+ * two-level aggregation over the ACC records (see __find_best_split). It
+ * collects the records of one (tid, nid, fid) group, one record per distinct
+ * (binned) feature value, into a histogram of class counts. The final
+ * function sorts the histogram once and scans it to get the SCV of every
+ * candidate split, so that only one row per (tid, nid, fid) is produced.
+ *
+ * We use a float8 array to keep the state of this aggregation. The enum
+ * types defines which element of that array is used for which purpose. The
+ * bins follow the header; each bin is the feature value followed by its
+ * class counts. The array has room for HIST_CAPACITY bins, and is only
+ * reallocated (doubling the capacity) when it is full.
+ *
+ */
+enum DT_HIST_STATE_ARRAY_INDEX
+{
+    /* 1 infogain, 2 gainratio, 3 gini */
+    HIST_SC_CODE = 0,
+
+    /* is continuous or not */
+    HIST_IS_CONT,
+
+    /* the total number of classes */
+    HIST_NUM_CLASS,
+
+    /* the true total number of samples, 0 if there is no missing value */
+    HIST_SAMPLE_TOTAL,
+
+    /* the number of bins in the histogram */
+    HIST_NUM_BINS,
+
+    /* the number of bins the state array has room for */
+    HIST_CAPACITY,
+
+    /* the first bin */
+    HIST_BINS
+};
+
+
+/* The initial number of bins of the histogram state */
+#define DT_HIST_INIT_CAPACITY 16
+
+
+/*
+ * @brief Validate the state array of the histogram aggregation.
+ *
+ * @param state     The state array.
+ *
+ * @return The data of the state array.
+ *
+ */
+static
+float8*
+dt_hist_get_state_data
+	(
+	ArrayType   *state
+	)
+{
+    dt_check_error
+        (
+            !ARR_HASNULL(state),
+            "the histogram state array cannot contain NULL values"
+        );
+
+    dt_check_error
+		(
+			1 == ARR_NDIM(state),
+			"the dimension of the histogram state array must be equal to 1"
+		);
+
+    float8 *data        = (float8 *)ARR_DATA_PTR(state);
+    int array_length    = ARR_DIMS(state)[0];
+
+    dt_check_error_value
+		(
+			array_length >= HIST_BINS &&
+			array_length == HIST_BINS + (int)data[HIST_CAPACITY] *
+			                ((int)data[HIST_NUM_CLASS] + 1),
+			"invalid histogram state array length: %d",
+			array_length
+		);
+
+    return data;
+}
+
+
+/*
+ * @brief Make sure the state array of the histogram aggregation has room
+ *        for the given number of bins.
+ *
+ * @param state         The state array.
+ * @param num_bins      The number of bins needed.
+ *
+ * @return The state array itself if it is large enough, otherwise a copy
+ *         of it with at least twice the capacity.
+ *
+ */
+static
+ArrayType*
+dt_hist_reserve
+	(
+	ArrayType   *state,
+	int         num_bins
+	)
+{
+    float8 *data        = (float8 *)ARR_DATA_PTR(state);
+    int capacity        = (int)data[HIST_CAPACITY];
+    int bin_size        = (int)data[HIST_NUM_CLASS] + 1;
+
+    if (num_bins <= capacity)
+        return state;
+
+    capacity <<= 1;
+    if (capacity < num_bins)
+        capacity = num_bins;
+
+    int array_length    = HIST_BINS + capacity * bin_size;
+    float8 *new_data    = palloc0(sizeof(float8) * array_length);
+
+    memcpy
+        (
+            new_data,
+            data,
+            sizeof(float8) * (HIST_BINS + (int)data[HIST_NUM_BINS] * bin_size)
+        );
+    new_data[HIST_CAPACITY] = capacity;
+
+    return construct_array
+        (
+            (Datum *)new_data,
+            array_length,
+            FLOAT8OID,
+            sizeof(float8),
+            true,
+            'd'
+        );
+}
+
+
+/*
+ * @brief The comparator to sort the bins by their feature values.
+ */
+static
+int
+dt_hist_bin_cmp
+	(
+	const void *bin1,
+	const void *bin2
+	)
+{
+    float8 fval1 = *(const float8 *)bin1;
+    float8 fval2 = *(const float8 *)bin2;
+
+    return fval1 < fval2 ? -1 : (fval1 > fval2 ? 1 : 0);
+}
+
+
+/*
+ * @brief The step function of the histogram based split finder. It appends
+ *        an ACC record to the histogram.
+ *
+ * @param state             The state array. Please refer to the definition
+ *                          of DT_HIST_STATE_ARRAY_INDEX.
+ * @param sc_code           1- infogain; 2- gainratio; 3- gini.
+ * @param is_cont           True  - The feature is continuous.
+ *                          False - The feature is discrete.
+ * @param num_class         The total number of classes.
+ * @param fval              The (binned) feature value of the ACC record.
+ * @param count             The class counts of the ACC record.
+ * @param true_total        The real total number of samples of the node. It
+ *                          is NULL if there is no missing value.
+ *
+ * @return The updated state array.
+ *
+ */
+Datum
+dt_hist_split_sfunc
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+    dt_check_error_value
+        (
+            (fcinfo->context && IsA(fcinfo->context, AggState)),
+            "%s can only be used in aggregations",
+            __FUNCTION__
+        );
+
+    int sc_type         = PG_GETARG_INT32(1);
+    bool is_cont_feat   = PG_ARGISNULL(2) ? 0 : PG_GETARG_BOOL(2);
+    int num_class       = PG_ARGISNULL(3) ? 0 : PG_GETARG_INT32(3);
+
+	dt_check_error_value
+		(
+			DT_SC_INFOGAIN  == sc_type ||
+			DT_SC_GAINRATIO == sc_type ||
+			DT_SC_GINI      == sc_type,
+			"invalid split criterion: %d. "
+			"It must be 1(infogain), 2(gainratio) or 3(gini)",
+			sc_type
+		);
+
+    dt_check_error_value
+		(
+			num_class >= 2,
+			"invalid value: %d. "
+			"The number of classes must be greater than or equal to 2",
+			num_class
+		);
+
+    dt_check_error
+        (
+            !PG_ARGISNULL(4) && !PG_ARGISNULL(5),
+            "the feature value and the class counts cannot be NULL"
+        );
+
+    float8 fval             = PG_GETARG_FLOAT8(4);
+    ArrayType *count_array  = PG_GETARG_ARRAYTYPE_P(5);
+    dt_check_error
+        (
+            1 == ARR_NDIM(count_array) && !ARR_HASNULL(count_array),
+            "the class count array must be one-dimensional without NULL values"
+        );
+    dt_check_error
+        (
+            ARR_DIMS(count_array)[0] == num_class,
+            "the size of class count array must be the number of class"
+        );
+    float8 *count_data      = (float8 *)ARR_DATA_PTR(count_array);
+
+    ArrayType *state        = NULL;
+    float8 *state_data      = NULL;
+    int num_bins            = 0;
+
+    if (PG_ARGISNULL(0))
     {
-        scv_state_data[SCV_SAMPLE_TOTAL] =
-        		scv_state_data[SCV_T];
+        int array_length    = HIST_BINS + DT_HIST_INIT_CAPACITY * (num_class + 1);
+        state_data          = palloc0(sizeof(float8) * array_length);
+
+        state_data[HIST_SC_CODE]        = sc_type;
+        state_data[HIST_IS_CONT]        = is_cont_feat;
+        state_data[HIST_NUM_CLASS]      = num_class;
+        state_data[HIST_SAMPLE_TOTAL]   = PG_ARGISNULL(6) ? 0 : PG_GETARG_INT64(6);
+        state_data[HIST_CAPACITY]       = DT_HIST_INIT_CAPACITY;
+
+        state = construct_array
+            (
+                (Datum *)state_data,
+                array_length,
+                FLOAT8OID,
+                sizeof(float8),
+                true,
+                'd'
+            );
     }
+    else
+    {
+        state       = PG_GETARG_ARRAYTYPE_P(0);
+        state_data  = dt_hist_get_state_data(state);
+
+        dt_check_error
+            (
+                (int)state_data[HIST_NUM_CLASS] == num_class,
+                "the number of classes must not change within a group"
+            );
+
+        num_bins    = (int)state_data[HIST_NUM_BINS];
+        state       = dt_hist_reserve(state, num_bins + 1);
+    }
+
+    state_data      = (float8 *)ARR_DATA_PTR(state);
+    float8 *bin     = state_data + HIST_BINS + num_bins * (num_class + 1);
+
+    bin[0] = fval;
+    memcpy(bin + 1, count_data, sizeof(float8) * num_class);
+    state_data[HIST_NUM_BINS] = num_bins + 1;
+
+    PG_RETURN_ARRAYTYPE_P(state);
+}
+PG_FUNCTION_INFO_V1(dt_hist_split_sfunc);
+
+
+/*
+ * @brief The pre-function of the histogram based split finder. It appends
+ *        the bins of the second state to the first one.
+ *
+ * @param state1    The state array from sfunc1.
+ * @param state2    The state array from sfunc2.
+ *
+ * @return The combined state array.
+ *
+ */
+Datum
+dt_hist_split_prefunc
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+    dt_check_error_value
+        (
+            (fcinfo->context && IsA(fcinfo->context, AggState)),
+            "%s can only be used in aggregations",
+            __FUNCTION__
+        );
+
+    if (PG_ARGISNULL(0))
+    {
+        if (PG_ARGISNULL(1))
+            PG_RETURN_NULL();
+
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(1));
+    }
+    else if (PG_ARGISNULL(1))
+    {
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+    }
+
+    ArrayType *state1   = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType *state2   = PG_GETARG_ARRAYTYPE_P(1);
+    float8 *state_data1 = dt_hist_get_state_data(state1);
+    float8 *state_data2 = dt_hist_get_state_data(state2);
 
-    /* true total count should be greater than 0*/
     dt_check_error
-    	(
-    		scv_state_data[SCV_SAMPLE_TOTAL] > 0 && scv_state_data[SCV_T] > 0,
-    		"true total count should be greater than 0"
-    	);
+        (
+            state_data1[HIST_NUM_CLASS] == state_data2[HIST_NUM_CLASS],
+            "the two histogram state arrays must have the same number of classes"
+        );
 
-    /* 
-     * For the following elements, such as max class id, we should copy
-     * them from step function array to final function array for returning.
-     */
-    result[SCV_FINAL_CLASS_ID]	    = scv_state_data[SCV_MAX_CLASS_ID];
-    result[SCV_FINAL_IS_CONT]   	= scv_state_data[SCV_IS_CONT];
-    result[SCV_FINAL_TOTAL_COUNT]   = scv_state_data[SCV_SAMPLE_TOTAL];
-    result[SCV_FINAL_CLASS_PROB]    = 
-        scv_state_data[SCV_MAX_CLASS_COUNT] / scv_state_data[SCV_SAMPLE_TOTAL];
+    int bin_size        = (int)state_data1[HIST_NUM_CLASS] + 1;
+    int num_bins1       = (int)state_data1[HIST_NUM_BINS];
+    int num_bins2       = (int)state_data2[HIST_NUM_BINS];
 
+    state1              = dt_hist_reserve(state1, num_bins1 + num_bins2);
+    state_data1         = (float8 *)ARR_DATA_PTR(state1);
 
-    if (DT_SC_INFOGAIN == ((int)scv_state_data[SCV_CODE]))
+    memcpy
+        (
+            state_data1 + HIST_BINS + num_bins1 * bin_size,
+            state_data2 + HIST_BINS,
+            sizeof(float8) * num_bins2 * bin_size
+        );
+    state_data1[HIST_NUM_BINS] = num_bins1 + num_bins2;
+
+    PG_RETURN_ARRAYTYPE_P(state1);
+}
+PG_FUNCTION_INFO_V1(dt_hist_split_prefunc);
+
+
+/*
+ * @brief The final function of the histogram based split finder. It sorts
+ *        the bins by feature value, and computes the SCV of the feature. For
+ *        a continuous feature, the class counts are accumulated along the
+ *        sorted bins, and the best split value is chosen. When the SCVs of
+ *        two split values tie, the larger split value is chosen, which is
+ *        the same as what __best_scv_aggr does.
+ *
+ * @param state     The state array. Please refer to the definition of
+ *                  DT_HIST_STATE_ARRAY_INDEX.
+ *
+ * @return A six-element array. Please refer to the definition of
+ *         DT_SCV_FINAL_ARRAY_INDEX for the first five elements. The last
+ *         element is the split value (0 for a discrete feature).
+ *
+ */
+Datum
+dt_hist_split_ffunc
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+    dt_check_error
+        (
+            !PG_ARGISNULL(0),
+            "the state array that fed into the final function "
+            "should not be null"
+        );
+
+    float8 *state_data  = dt_hist_get_state_data(PG_GETARG_ARRAYTYPE_P(0));
+    int sc_type         = (int)state_data[HIST_SC_CODE];
+    bool is_cont_feat   = state_data[HIST_IS_CONT] > 0;
+    int num_class       = (int)state_data[HIST_NUM_CLASS];
+    int num_bins        = (int)state_data[HIST_NUM_BINS];
+    int bin_size        = num_class + 1;
+    int i               = 0;
+    int j               = 0;
+    int k               = 0;
+
+    dt_check_error(num_bins > 0, "the histogram cannot be empty");
+
+    /* sort a copy of the bins, and merge the bins with the same value */
+    float8 *bins = palloc(sizeof(float8) * num_bins * bin_size);
+    memcpy(bins, state_data + HIST_BINS, sizeof(float8) * num_bins * bin_size);
+    qsort(bins, num_bins, sizeof(float8) * bin_size, dt_hist_bin_cmp);
+
+    for (k = 1; k < num_bins; ++k)
     {
-        // info gain
-        result[SCV_FINAL_VALUE] = 
-            log(scv_state_data[SCV_T]) - 
-             ((scv_state_data[SCV_U] + scv_state_data[SCV_V] -
-              scv_state_data[SCV_W]) / scv_state_data[SCV_T]);
+        if (bins[k * bin_size] == bins[j * bin_size])
+        {
+            for (i = 1; i < bin_size; ++i)
+                bins[j * bin_size + i] += bins[k * bin_size + i];
+        }
+        else if (++j < k)
+        {
+            memcpy
+                (
+                    bins + j * bin_size,
+                    bins + k * bin_size,
+                    sizeof(float8) * bin_size
+                );
+        }
     }
-    else if (DT_SC_GAINRATIO == ((int)scv_state_data[SCV_CODE]))
+    num_bins = j + 1;
+
+    float8 *total_data  = palloc0(sizeof(float8) * num_class);
+    float8 *le_data     = palloc0(sizeof(float8) * num_class);
+    for (k = 0; k < num_bins; ++k)
+        for (i = 0; i < num_class; ++i)
+            total_data[i] += bins[k * bin_size + i + 1];
+
+    float8 scv_state_data[SCV_MAX_CLASS_COUNT + 1];
+    float8 scv_final_data[SCV_FINAL_TOTAL_COUNT + 1];
+    int result_size     = SCV_FINAL_TOTAL_COUNT + 2;
+    float8 *result      = palloc0(sizeof(float8) * result_size);
+
+    if (is_cont_feat)
     {
-        // gain ratio
-        tmp = dt_cal_log(scv_state_data[SCV_T]) - scv_state_data[SCV_V];
-        result[SCV_FINAL_VALUE] = dt_is_float_zero(tmp) ? 0.0 :
-            1 + (scv_state_data[SCV_W] - scv_state_data[SCV_U]) / tmp;
+        for (k = 0; k < num_bins; ++k)
+        {
+            for (i = 0; i < num_class; ++i)
+                le_data[i] += bins[k * bin_size + i + 1];
+
+            memset(scv_state_data, 0, sizeof(scv_state_data));
+            scv_state_data[SCV_CODE]            = sc_type;
+            scv_state_data[SCV_IS_CONT]         = 1;
+            scv_state_data[SCV_SAMPLE_TOTAL]    = state_data[HIST_SAMPLE_TOTAL];
+            dt_scv_accumulate
+                (
+                    scv_state_data,
+                    sc_type,
+                    true,
+                    num_class,
+                    le_data,
+                    total_data
+                );
+            dt_scv_finalize(scv_state_data, scv_final_data);
+
+            if (0 == k ||
+                scv_final_data[SCV_FINAL_VALUE] - result[SCV_FINAL_VALUE] >
+                    -DT_EPSILON)
+            {
+                memcpy(result, scv_final_data, sizeof(scv_final_data));
+                result[SCV_FINAL_TOTAL_COUNT + 1] = bins[k * bin_size];
+            }
+        }
     }
     else
     {
-        //gini index
-        result[SCV_FINAL_VALUE] = 
-            (scv_state_data[SCV_W] / scv_state_data[SCV_T]) -
-            (scv_state_data[SCV_U]) / dt_cal_sqr(scv_state_data[SCV_T]);
+        memset(scv_state_data, 0, sizeof(scv_state_data));
+        scv_state_data[SCV_CODE]            = sc_type;
+        scv_state_data[SCV_SAMPLE_TOTAL]    = state_data[HIST_SAMPLE_TOTAL];
+        for (k = 0; k < num_bins; ++k)
+            dt_scv_accumulate
+                (
+                    scv_state_data,
+                    sc_type,
+                    false,
+                    num_class,
+                    bins + k * bin_size + 1,
+                    total_data
+                );
+        dt_scv_finalize(scv_state_data, result);
     }
-    
-    result[SCV_FINAL_VALUE] *= (scv_state_data[SCV_T] / 
-            scv_state_data[SCV_SAMPLE_TOTAL]); 
-
-    dtelog(NOTICE, "final value: %lf", result[SCV_FINAL_VALUE]);
 
     ArrayType* result_array =
         construct_array(
@@ -1738,76 +2296,97 @@ dt_scv_aggr_ffunc
 
     PG_RETURN_ARRAYTYPE_P(result_array);
 }
-PG_FUNCTION_INFO_V1(dt_scv_aggr_ffunc);
+PG_FUNCTION_INFO_V1(dt_hist_split_ffunc);
 
 
 /*
- * @brief The function samples a set of integer values between low and high.
- *        The sample method is 'sample with replacement', which means a sample
- *        could be chosen multiple times.
+ * @brief Mix the bits of a 64-bit integer (the finalizer of SplitMix64).
+ *
+ * @param x     The value to be mixed.
  *
- * @param sample_size     Number of records to be sampled.
- * @param low             Low limit of sampled values.
- * @param high            High limit of sampled values.
- * @param seed            Seed for random number.
+ * @return The mixed value.
  *
- * @return A set of integer values sampled randomly between [low, high].
+ */
+static
+uint64
+dt_hash_mix
+	(
+	uint64 x
+	)
+{
+    x += UINT64CONST(0x9E3779B97F4A7C15);
+    x  = (x ^ (x >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+    x  = (x ^ (x >> 27)) * UINT64CONST(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+
+/*
+ * @brief The function computes the bootstrap weight of a record for a tree.
+ *        Instead of sampling the records of each tree with replacement, each 
+ *        record gets a Poisson distributed weight for every tree. The weight 
+ *        is computed from a hash of the record ID, the tree ID and a seed, 
+ *        so that no random state is kept, and the weights of all the trees 
+ *        can be computed in one scan of the training table.
+ *
+ * @param id        The ID of the record.
+ * @param tid       The ID of the tree.
+ * @param lambda    The expected weight of a record, that is, the number of 
+ *                  records to be sampled for a tree divided by the number of
+ *                  records.
+ * @param seed      The seed of the hash.
+ *
+ * @return The number of times the record is sampled for the tree.
  *
  */
 Datum
-dt_sample_within_range
+dt_poisson_bootstrap_weight
 	(
 	PG_FUNCTION_ARGS
 	)
 {
-    FuncCallContext     *funcctx 	= NULL;
-    int64               call_cntr	= 0;
-    int64               max_calls	= 0;
-
-    /* stuff done only on the first call of the function */
-    if (SRF_IS_FIRSTCALL())
-    {
-        MemoryContext   oldcontext;
+    int64 id        = PG_GETARG_INT64(0);
+    int32 tid       = PG_GETARG_INT32(1);
+    float8 lambda   = PG_GETARG_FLOAT8(2);
+    int32 seed      = PG_GETARG_INT32(3);
 
-        /* create a function context for cross-call persistence */
-        funcctx = SRF_FIRSTCALL_INIT();
+    dt_check_error_value
+		(
+			lambda > 0,
+			"invalid expected weight: %lf. "
+			"It must be greater than 0",
+			lambda
+		);
 
-        /* switch to memory context appropriate for multiple function calls */
-        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
-        int64  low = PG_GETARG_INT64(1);
-        int64 high = PG_GETARG_INT64(2);
+    dt_check_error_value
+		(
+			lambda <= MAX_DT_POISSON_LAMBDA,
+			"invalid expected weight: %lf. "
+			"It must not be greater than 700",
+			lambda
+		);
 
-		dt_check_error
-			(
-				low<=high && low>=0,
-				"The low margin must not be greater than the high margin. "
-           		"And negative numbers are not accepted"
-			);
+    uint64 hash     = dt_hash_mix((uint64)seed);
+    hash            = dt_hash_mix(hash ^ (uint64)id);
+    hash            = dt_hash_mix(hash ^ (uint64)tid);
 
-        /* total number of samples to be returned */
-        funcctx->max_calls = PG_GETARG_INT64(0);
-        MemoryContextSwitchTo(oldcontext);
-    }
+    /* the 53 high bits as a uniform number in [0, 1) */
+    float8 u        = (hash >> 11) * (1.0 / 9007199254740992.0);
 
-    /* stuff done on every call of the function */
-    funcctx   = SRF_PERCALL_SETUP();
-    call_cntr = funcctx->call_cntr;
-    max_calls = funcctx->max_calls;
- 
-    /* when there is more records to return */
-    if (call_cntr < max_calls)
+    /* inversion of the Poisson CDF */
+    int32 weight    = 0;
+    float8 prob     = exp(-lambda);
+    float8 cdf      = prob;
+    while (u > cdf && prob > 0)
     {
-        int64       low			= PG_GETARG_INT64(1);
-        int64       high		= PG_GETARG_INT64(2);
-        float8      rand_num	= (random()/(float8)(RAND_MAX+1.0));
-        int64       selection	= (int64)(rand_num*(high-low+1)+low);
-        SRF_RETURN_NEXT(funcctx, Int64GetDatum(selection));
+        ++weight;
+        prob *= lambda / weight;
+        cdf  += prob;
     }
 
-    /* when there is no more records left */
-    SRF_RETURN_DONE(funcctx);
+    PG_RETURN_INT32(weight);
 }
-PG_FUNCTION_INFO_V1(dt_sample_within_range);
+PG_FUNCTION_INFO_V1(dt_poisson_bootstrap_weight);
 
 
 /*
@@ -0,0 +1,301 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file regex_features.c
+ *
+ * @brief Match a token against all regular-expression features of a CRF at
+ *     once
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include "postgres.h"
+#include <string.h>
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "regex/regex.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+#ifndef NO_PG_MODULE_MAGIC
+PG_MODULE_MAGIC;
+#endif
+
+Datum crf_regex_features(PG_FUNCTION_ARGS);
+
+/*
+ * The compiled patterns. The regex library allocates its automata with
+ * malloc(), so they must not be owned by a memory context that goes away
+ * with the query (that would leak them). Like RE_compile_and_cache() in the
+ * backend, we therefore keep them in a static cache, which is keyed by the
+ * pattern array and freed with pg_regfree() when the patterns change. During
+ * feature generation the patterns are the same for every token, so they are
+ * compiled once per backend.
+ */
+typedef struct
+{
+    char       *key;        /* copy of the pattern array (malloc'ed) */
+    Size        key_size;
+    Oid         collation;
+    int         npatterns;
+    regex_t    *regexes;    /* npatterns compiled patterns (malloc'ed) */
+} RegexFeatureSet;
+
+static RegexFeatureSet compiled_set = {NULL, 0, InvalidOid, 0, NULL};
+
+/*
+ * Per call site state in fn_extra: the feature names for the current name
+ * array, and a conversion buffer for the token, so that matching a token
+ * does not allocate.
+ */
+typedef struct
+{
+    char       *key;        /* copy of the name array */
+    Size        key_size;
+    int         nnames;
+    Datum      *f_names;    /* 'R_' || name, as text */
+    int         wide_size;
+    pg_wchar   *wide;
+} RegexFeatureNames;
+
+#if PG_VERSION_NUM >= 90100
+#define CRF_REGCOMP(re, str, len, collation) \
+    pg_regcomp((re), (str), (len), REG_ADVANCED, (collation))
+#else
+#define CRF_REGCOMP(re, str, len, collation) \
+    pg_regcomp((re), (str), (len), REG_ADVANCED)
+#endif
+
+static void
+regex_feature_set_free(void)
+{
+    int i;
+
+    for (i = 0; i < compiled_set.npatterns; i++)
+        pg_regfree(&compiled_set.regexes[i]);
+    if (compiled_set.regexes != NULL)
+        free(compiled_set.regexes);
+    if (compiled_set.key != NULL)
+        free(compiled_set.key);
+    compiled_set.key = NULL;
+    compiled_set.key_size = 0;
+    compiled_set.npatterns = 0;
+    compiled_set.regexes = NULL;
+}
+
+/*
+ * Make sure that compiled_set holds the given patterns, compiled with the
+ * flags of the ~ operator.
+ */
+static void
+regex_feature_set_compile(ArrayType *patterns, Oid collation)
+{
+    Size        key_size = VARSIZE(patterns);
+    Datum      *elems;
+    bool       *nulls;
+    int         nelems;
+    int         i;
+
+    if (compiled_set.key != NULL && compiled_set.key_size == key_size &&
+        compiled_set.collation == collation &&
+        memcmp(compiled_set.key, patterns, key_size) == 0)
+        return;
+
+    regex_feature_set_free();
+    deconstruct_array(patterns, TEXTOID, -1, false, 'i',
+                      &elems, &nulls, &nelems);
+
+    compiled_set.regexes = (regex_t *) malloc(Max(nelems, 1) * sizeof(regex_t));
+    if (compiled_set.regexes == NULL)
+        ereport(ERROR,
+                (errcode(ERRCODE_OUT_OF_MEMORY),
+                 errmsg("out of memory")));
+
+    for (i = 0; i < nelems; i++)
+    {
+        text       *pattern;
+        pg_wchar   *wide;
+        int         len, wide_len, status;
+
+        if (nulls[i])
+            ereport(ERROR,
+                    (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                     errmsg("regular expression must not be NULL")));
+
+        pattern = DatumGetTextPP(elems[i]);
+        len = VARSIZE_ANY_EXHDR(pattern);
+        wide = (pg_wchar *) palloc((len + 1) * sizeof(pg_wchar));
+        wide_len = pg_mb2wchar_with_len(VARDATA_ANY(pattern), wide, len);
+
+        status = CRF_REGCOMP(&compiled_set.regexes[i], wide, wide_len,
+                             collation);
+        pfree(wide);
+        if (status != REG_OKAY)
+        {
+            char errMsg[100];
+
+            pg_regerror(status, &compiled_set.regexes[i], errMsg,
+                        sizeof(errMsg));
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_REGULAR_EXPRESSION),
+                     errmsg("invalid regular expression: %s", errMsg)));
+        }
+        compiled_set.npatterns = i + 1;
+    }
+
+    /* only a complete set becomes valid */
+    compiled_set.key = (char *) malloc(key_size);
+    if (compiled_set.key == NULL)
+        ereport(ERROR,
+                (errcode(ERRCODE_OUT_OF_MEMORY),
+                 errmsg("out of memory")));
+    memcpy(compiled_set.key, patterns, key_size);
+    compiled_set.key_size = key_size;
+    compiled_set.collation = collation;
+}
+
+/*
+ * Return the feature names for the given name array, building them only if
+ * the names differ from those of the previous call.
+ */
+static RegexFeatureNames *
+regex_feature_names(FunctionCallInfo fcinfo, ArrayType *names)
+{
+    RegexFeatureNames *extra = (RegexFeatureNames *) fcinfo->flinfo->fn_extra;
+    Size        key_size = VARSIZE(names);
+    MemoryContext oldcontext;
+    Datum      *elems;
+    bool       *nulls;
+    int         nelems;
+    int         i;
+
+    if (extra == NULL)
+    {
+        extra = (RegexFeatureNames *) MemoryContextAllocZero(
+            fcinfo->flinfo->fn_mcxt, sizeof(RegexFeatureNames));
+        fcinfo->flinfo->fn_extra = extra;
+    }
+    if (extra->key != NULL && extra->key_size == key_size &&
+        memcmp(extra->key, names, key_size) == 0)
+        return extra;
+
+    oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+    deconstruct_array(names, TEXTOID, -1, false, 'i',
+                      &elems, &nulls, &nelems);
+    extra->f_names = (Datum *) palloc(Max(nelems, 1) * sizeof(Datum));
+    for (i = 0; i < nelems; i++)
+    {
+        char *name;
+        char *f_name;
+
+        if (nulls[i])
+            ereport(ERROR,
+                    (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                     errmsg("regular expression name must not be NULL")));
+        name = TextDatumGetCString(elems[i]);
+        f_name = (char *) palloc(strlen(name) + 3);
+        sprintf(f_name, "R_%s", name);
+        extra->f_names[i] = CStringGetTextDatum(f_name);
+    }
+    extra->nnames = nelems;
+    extra->key = (char *) palloc(key_size);
+    memcpy(extra->key, names, key_size);
+    extra->key_size = key_size;
+    MemoryContextSwitchTo(oldcontext);
+    return extra;
+}
+
+/**
+ * @brief Return the regex features ('R_' || name) of all patterns that match
+ *     the token
+ *
+ * This is a set-returning function in materialize mode, so that fn_extra is
+ * ours across rows.
+ */
+PG_FUNCTION_INFO_V1(crf_regex_features);
+Datum
+crf_regex_features(PG_FUNCTION_ARGS)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    text       *token = PG_GETARG_TEXT_PP(0);
+    ArrayType  *names = PG_GETARG_ARRAYTYPE_P(1);
+    ArrayType  *patterns = PG_GETARG_ARRAYTYPE_P(2);
+    RegexFeatureNames *extra;
+    Tuplestorestate *tupstore;
+    TupleDesc   tupdesc;
+    MemoryContext oldcontext;
+    Oid         collation = InvalidOid;
+    int         len, wide_len;
+    int         i;
+
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+        (rsinfo->allowedModes & SFRM_Materialize) == 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                 errmsg("materialize mode required, but it is not "
+                        "allowed in this context")));
+
+    if (ARR_NDIM(names) > 1 || ARR_NDIM(patterns) > 1 ||
+        ArrayGetNItems(ARR_NDIM(names), ARR_DIMS(names)) !=
+        ArrayGetNItems(ARR_NDIM(patterns), ARR_DIMS(patterns)))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("names and patterns must be one-dimensional arrays "
+                        "of the same length")));
+
+#if PG_VERSION_NUM >= 90100
+    collation = PG_GET_COLLATION();
+#endif
+    regex_feature_set_compile(patterns, collation);
+    extra = regex_feature_names(fcinfo, names);
+
+    /* convert the token once for all patterns */
+    len = VARSIZE_ANY_EXHDR(token);
+    if (extra->wide_size < len + 1)
+    {
+        if (extra->wide != NULL)
+            pfree(extra->wide);
+        extra->wide_size = Max(len + 1, 2 * extra->wide_size);
+        extra->wide = (pg_wchar *) MemoryContextAlloc(
+            fcinfo->flinfo->fn_mcxt, extra->wide_size * sizeof(pg_wchar));
+    }
+    wide_len = pg_mb2wchar_with_len(VARDATA_ANY(token), extra->wide, len);
+
+    oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+    tupdesc = CreateTemplateTupleDesc(1, false);
+    TupleDescInitEntry(tupdesc, (AttrNumber) 1, "f_name", TEXTOID, -1, 0);
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    MemoryContextSwitchTo(oldcontext);
+
+    for (i = 0; i < compiled_set.npatterns; i++)
+    {
+        int status = pg_regexec(&compiled_set.regexes[i], extra->wide,
+                                wide_len, 0, NULL, 0, NULL, 0);
+
+        if (status == REG_OKAY)
+        {
+            bool isnull = false;
+
+            tuplestore_putvalues(tupstore, tupdesc, &extra->f_names[i],
+                                 &isnull);
+        }
+        else if (status != REG_NOMATCH)
+        {
+            char errMsg[100];
+
+            pg_regerror(status, &compiled_set.regexes[i], errMsg,
+                        sizeof(errMsg));
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_REGULAR_EXPRESSION),
+                     errmsg("regular expression failed: %s", errMsg)));
+        }
+    }
+    tuplestore_donestoring(tupstore);
+
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+    return (Datum) 0;
+}
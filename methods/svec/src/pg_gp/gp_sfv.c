@@ -2,12 +2,13 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <search.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "access/hash.h"
 #include "access/tupmacs.h"
 #include "catalog/pg_type.h"
+#include "nodes/primnodes.h"
 #if PG_VERSION_NUM >= 90100
 #include "catalog/pg_collation.h"
 #endif
@@ -19,9 +20,37 @@
 
 Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS);
 
+/*
+ * The dictionary of gp_extract_feature_histogram, prepared for lookups.
+ *
+ * It is built on the first call and kept in fn_extra, so that the
+ * dictionary is validated and hashed only once per query. The words are
+ * stored in an open-addressing hash table with linear probing; a slot holds
+ * the position of the word in the dictionary plus one (zero marks an empty
+ * slot).
+ *
+ * If the dictionary argument is a constant or a parameter, every call of
+ * the query passes the same datum, so that the cached dictionary is found
+ * by comparing the (not yet detoasted) datum only. Otherwise, the whole
+ * dictionary is compared with the cached copy.
+ */
+typedef struct
+{
+	Datum		raw;			/* dictionary argument of the last call */
+	bool		is_fixed;		/* whether the argument is a Const or Param */
+	ArrayType  *dict;			/* copy of the dictionary array */
+	Datum	   *features;		/* words of the dictionary, pointing into dict */
+	int			num_features;
+	int32	   *slots;
+	uint32		mask;			/* number of slots minus one */
+} FeatureDictionary;
+
 static void gp_extract_feature_histogram_errout(char *msg);
 
-static SvecType * classify_document(Datum *features, int num_features,
+static FeatureDictionary *get_feature_dictionary(FunctionCallInfo fcinfo,
+				  Datum raw);
+
+static SvecType * classify_document(FeatureDictionary *dict,
 				  Datum *document, int num_words, bool *null_words);
 
 #if PG_VERSION_NUM >= 90100
@@ -112,14 +141,14 @@ PG_FUNCTION_INFO_V1( gp_extract_feature_histogram );
 Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS)
 {
 	SvecType   *returnval;
-	ArrayType  *arr0, *arr1;
-	Datum	   *features, *document;
-	int			num_features, num_words;
+	ArrayType  *arr1;
+	FeatureDictionary *dict;
+	Datum	   *document;
+	int			num_words;
 	bool	   *null_words;
 	int16		elmlen;
 	bool		elmbyval;
 	char		elmalign;
-	int			i;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
@@ -129,94 +158,306 @@ Datum gp_extract_feature_histogram(PG_FUNCTION_ARGS)
 		gp_extract_feature_histogram_errout(
 			"gp_extract_feature_histogram called with wrong number of arguments");
 
-	arr0 = PG_GETARG_ARRAYTYPE_P(0);
 	arr1 = PG_GETARG_ARRAYTYPE_P(1);
 
+	if (ARR_ELEMTYPE(arr1) != TEXTOID)
+		gp_extract_feature_histogram_errout("the input types must be text[]");
+
+	/* The dictionary is detoasted and checked only if it is not cached */
+	dict = get_feature_dictionary(fcinfo, PG_GETARG_DATUM(0));
+
+	get_typlenbyvalalign(TEXTOID, &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(arr1, TEXTOID, elmlen, elmbyval, elmalign,
+					  &document, &null_words, &num_words);
+
+	returnval = classify_document(dict, document, num_words, null_words);
+	pfree(document);
+	pfree(null_words);
+
+	PG_RETURN_POINTER(returnval);
+}
+
+static void
+gp_extract_feature_histogram_errout(char *msg) {
+	ereport(ERROR,
+		(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+		 errmsg(
+		"%s\ngp_extract_feature_histogram internal error.",msg)));
+}
+
+static uint32
+text_hash(Datum word)
+{
+	return DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(word),
+								   VARSIZE_ANY_EXHDR(word)));
+}
+
+static bool
+text_equal(Datum a, Datum b)
+{
+	int		len = VARSIZE_ANY_EXHDR(a);
+
+	return len == VARSIZE_ANY_EXHDR(b) &&
+		memcmp(VARDATA_ANY(a), VARDATA_ANY(b), len) == 0;
+}
+
+/*
+ * Whether the dictionary argument is the same datum in every call of the
+ * query, i.e., a constant or an external parameter. Executor parameters
+ * (PARAM_EXEC) are not: correlated subqueries and nested loops set them
+ * once per outer row, and a new value may be allocated at the address of
+ * the previous one.
+ */
+static bool
+dictionary_is_fixed(FmgrInfo *flinfo)
+{
+	Node	   *arg;
+
+	if (flinfo->fn_expr == NULL || !IsA(flinfo->fn_expr, FuncExpr))
+		return false;
+
+	arg = (Node *) linitial(((FuncExpr *) flinfo->fn_expr)->args);
+	while (arg != NULL && IsA(arg, RelabelType))
+		arg = (Node *) ((RelabelType *) arg)->arg;
+
+	return arg != NULL && (IsA(arg, Const) ||
+		(IsA(arg, Param) && ((Param *) arg)->paramkind == PARAM_EXTERN));
+}
+
+/*
+ * Return the prepared dictionary for the given array, building it if the
+ * cached one in fn_extra is missing or was built from a different array.
+ *
+ * The dictionary must be sorted and free of duplicates. This is checked
+ * (with the collation-aware comparison) only when the dictionary is built.
+ */
+static FeatureDictionary *
+get_feature_dictionary(FunctionCallInfo fcinfo, Datum raw)
+{
+	FeatureDictionary *dict = (FeatureDictionary *) fcinfo->flinfo->fn_extra;
+	ArrayType  *arr;
+	MemoryContext oldcontext;
+	int16		elmlen;
+	bool		elmbyval;
+	char		elmalign;
+	uint32		num_slots;
+	int			i;
+
+	if (dict != NULL && dict->is_fixed && dict->raw == raw)
+		return dict;
+
+	arr = DatumGetArrayTypeP(raw);
+
+	if (dict != NULL)
+	{
+		if (VARSIZE(dict->dict) == VARSIZE(arr) &&
+			memcmp(dict->dict, arr, VARSIZE(arr)) == 0)
+		{
+			dict->raw = raw;
+			return dict;
+		}
+
+		pfree(dict->slots);
+		pfree(dict->features);
+		pfree(dict->dict);
+		pfree(dict);
+		fcinfo->flinfo->fn_extra = NULL;
+	}
+
 	/* Error if dictionary is empty or contains a null */
-	if (ARR_HASNULL(arr0))
+	if (ARR_HASNULL(arr))
 		gp_extract_feature_histogram_errout(
 		  "dictionary argument contains a null entry");
 
-	if (ARR_NDIM(arr0) == 0)
+	if (ARR_NDIM(arr) == 0)
 		gp_extract_feature_histogram_errout(
 		  "dictionary argument is empty");
 
-	if (ARR_ELEMTYPE(arr0) != TEXTOID || ARR_ELEMTYPE(arr1) != TEXTOID)
+	if (ARR_ELEMTYPE(arr) != TEXTOID)
 		gp_extract_feature_histogram_errout("the input types must be text[]");
 
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+	dict = (FeatureDictionary *) palloc(sizeof(FeatureDictionary));
+	dict->raw = raw;
+	dict->is_fixed = dictionary_is_fixed(fcinfo->flinfo);
+	dict->dict = (ArrayType *) palloc(VARSIZE(arr));
+	memcpy(dict->dict, arr, VARSIZE(arr));
+
 	get_typlenbyvalalign(TEXTOID, &elmlen, &elmbyval, &elmalign);
-	deconstruct_array(arr0, TEXTOID, elmlen, elmbyval, elmalign,
-					  &features, NULL, &num_features);
-	deconstruct_array(arr1, TEXTOID, elmlen, elmbyval, elmalign,
-					  &document, &null_words, &num_words);
+	deconstruct_array(dict->dict, TEXTOID, elmlen, elmbyval, elmalign,
+					  &dict->features, NULL, &dict->num_features);
 
-	for (i = 0; i < num_features - 1; i++)
+	for (i = 0; i < dict->num_features - 1; i++)
 	{
 		int		cmp;
 
-		cmp = TextDatumCmp(features[i], features[i + 1]);
+		cmp = TextDatumCmp(dict->features[i], dict->features[i + 1]);
 
 		if (cmp > 0)
 			elog(ERROR, "Dictionary is unsorted: '%s' is out of order.\n",
-					TextDatumGetCString(features[i + 1]));
+					TextDatumGetCString(dict->features[i + 1]));
 		else if (cmp == 0)
 			elog(ERROR, "Dictionary has duplicated word: '%s'\n",
-					TextDatumGetCString(features[i + 1]));
+					TextDatumGetCString(dict->features[i + 1]));
 	}
 
-	returnval = classify_document(features, num_features,
-								  document, num_words, null_words);
-	pfree(features);
-	pfree(document);
+	/* Keep the load factor at or below one half */
+	num_slots = 16;
+	while (num_slots < 2 * (uint32) dict->num_features)
+		num_slots <<= 1;
+	dict->mask = num_slots - 1;
+	dict->slots = (int32 *) palloc0(sizeof(int32) * num_slots);
 
-	PG_RETURN_POINTER(returnval);
-}
+	for (i = 0; i < dict->num_features; i++)
+	{
+		uint32	slot = text_hash(dict->features[i]) & dict->mask;
 
-static void
-gp_extract_feature_histogram_errout(char *msg) {
-	ereport(ERROR,
-		(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
-		 errmsg(
-		"%s\ngp_extract_feature_histogram internal error.",msg)));
+		while (dict->slots[slot] != 0)
+			slot = (slot + 1) & dict->mask;
+		dict->slots[slot] = i + 1;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	fcinfo->flinfo->fn_extra = dict;
+
+	return dict;
 }
 
 /*
- * The comparator for bsearch.
+ * Return the position of the word in the dictionary, or -1 if it is not in
+ * the dictionary.
  */
 static int
-textdatum_cmp(const void *a, const void *b)
+lookup_feature(FeatureDictionary *dict, Datum word)
+{
+	uint32	slot = text_hash(word) & dict->mask;
+
+	while (dict->slots[slot] != 0)
+	{
+		int		idx = dict->slots[slot] - 1;
+
+		if (text_equal(dict->features[idx], word))
+			return idx;
+		slot = (slot + 1) & dict->mask;
+	}
+	return -1;
+}
+
+static int
+int_cmp(const void *a, const void *b)
+{
+	int		x = *(const int *) a;
+	int		y = *(const int *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Append a run to the SparseData under construction, merging it with the
+ * pending run if both have the same value.
+ */
+static void
+append_run(SparseData sdata, float8 *run_val, int64 *run_len,
+		   float8 val, int64 len)
 {
-	return TextDatumCmp(*(Datum *) a, *(Datum *) b);
+	if (*run_len > 0 && *run_val == val)
+	{
+		*run_len += len;
+		return;
+	}
+	if (*run_len > 0)
+		add_run_to_sdata((char *) run_val, *run_len, sizeof(float8), sdata);
+	*run_val = val;
+	*run_len = len;
 }
 
+/*
+ * Count the dictionary words of the document and return the counts as an
+ * svec of the size of the dictionary.
+ *
+ * The counts are collected in a small hash table keyed by the position in
+ * the dictionary, and the runs of the svec are emitted from the sorted
+ * positions. The cost is therefore linear in the number of words of the
+ * document and does not depend on the size of the dictionary.
+ */
 static SvecType *
-classify_document(Datum *features, int num_features,
+classify_document(FeatureDictionary *dict,
 				  Datum *document, int num_words, bool *null_words)
 {
-	float8 * histogram = (float8 *)palloc0(sizeof(float8)*num_features);
-	SvecType * output_sfv;
-	int i;
+	SvecType   *output_sfv;
+	SparseData	sdata;
+	int		   *keys;
+	float8	   *counts;
+	int		   *found;
+	int			num_found = 0;
+	uint32		num_slots = 16;
+	uint32		mask;
+	float8		run_val = 0;
+	int64		run_len = 0;
+	int			pos = 0;
+	int			i;
+
+	while (num_slots < 2 * (uint32) num_words)
+		num_slots <<= 1;
+	mask = num_slots - 1;
+	keys = (int *) palloc(sizeof(int) * num_slots);
+	counts = (float8 *) palloc(sizeof(float8) * num_slots);
+	found = (int *) palloc(sizeof(int) * num_slots);
+	memset(keys, -1, sizeof(int) * num_slots);
 
 	for (i = 0; i < num_words; i++)
 	{
-		void   *found;
+		int		idx;
+		uint32	slot;
 
 		/* Skip if this word is NULL */
 		if (null_words[i])
 			continue;
-		found = bsearch(&document[i], features, num_features,
-						sizeof(Datum), textdatum_cmp);
-		if (found)
-		{
-			int		idx;
+		idx = lookup_feature(dict, document[i]);
+		if (idx < 0)
+			continue;
 
-			idx = ((uintptr_t) found - (uintptr_t) features) / sizeof(Datum);
-			histogram[idx]++;
+		slot = ((uint32) idx * 2654435761U) & mask;
+		while (keys[slot] >= 0 && keys[slot] != idx)
+			slot = (slot + 1) & mask;
+		if (keys[slot] < 0)
+		{
+			keys[slot] = idx;
+			counts[slot] = 0;
+			found[num_found++] = slot;
 		}
+		counts[slot]++;
+	}
+
+	/* Sort the occupied slots by position in the dictionary */
+	for (i = 0; i < num_found; i++)
+		found[i] = keys[found[i]];
+	qsort(found, num_found, sizeof(int), int_cmp);
+
+	sdata = makeSparseData();
+	for (i = 0; i < num_found; i++)
+	{
+		int		idx = found[i];
+		uint32	slot = ((uint32) idx * 2654435761U) & mask;
+
+		while (keys[slot] != idx)
+			slot = (slot + 1) & mask;
 
+		if (idx > pos)
+			append_run(sdata, &run_val, &run_len, 0, idx - pos);
+		append_run(sdata, &run_val, &run_len, counts[slot], 1);
+		pos = idx + 1;
 	}
-	output_sfv = svec_from_float8arr(histogram, num_features);
-	pfree(histogram);
+	if (pos < dict->num_features)
+		append_run(sdata, &run_val, &run_len, 0, dict->num_features - pos);
+	add_run_to_sdata((char *) &run_val, run_len, sizeof(float8), sdata);
+
+	output_sfv = svec_from_sparsedata(sdata, true);
+	freeSparseDataAndData(sdata);
+	pfree(keys);
+	pfree(counts);
+	pfree(found);
 
 	return output_sfv;
 }
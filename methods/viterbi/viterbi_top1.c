@@ -4,16 +4,14 @@
 #include "utils/array.h"
 #include <math.h>
 #include "catalog/pg_type.h"
+#include "utils/lsyscache.h"
 
 #ifndef NO_PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
 #endif
 
-#ifndef min
-#define min(a,b)((a) < (b) ? (a):(b))
-#endif
-
 Datum vcrf_top1_label(PG_FUNCTION_ARGS);
+Datum vcrf_topk_label(PG_FUNCTION_ARGS);
 
 /**
  * @file viterbi_top1.c
@@ -28,120 +26,461 @@ Datum vcrf_top1_label(PG_FUNCTION_ARGS);
  *         the fist number is the numerator, the second number is the normalization factor.
  **/
 
+/*
+ * Layout of the m factors (marray): the first nlabel entries are the start
+ * feature, followed by one row of nlabel transition scores for every previous
+ * label, followed by nlabel entries for the end feature.
+ */
+#define START_FACTORS(m, nlabel) (m)
+#define TRANS_FACTORS(m, nlabel) ((m) + (nlabel))
+#define END_FACTORS(m, nlabel) ((m) + ((nlabel) + 1) * (nlabel))
+
+/*
+ * Scratch memory that survives across calls of the same function invocation
+ * site. All decoding buffers are carved out of it, so that decoding a whole
+ * table of documents only allocates when a document is longer than any
+ * document seen before.
+ */
+typedef struct
+{
+    Size    size;
+    char   *data;
+} ViterbiScratch;
+
+static char *
+viterbi_scratch(FunctionCallInfo fcinfo, Size nbytes)
+{
+    ViterbiScratch *scratch = (ViterbiScratch *) fcinfo->flinfo->fn_extra;
+
+    if (scratch == NULL)
+    {
+        scratch = (ViterbiScratch *) MemoryContextAllocZero(
+            fcinfo->flinfo->fn_mcxt, sizeof(ViterbiScratch));
+        fcinfo->flinfo->fn_extra = scratch;
+    }
+    if (scratch->size < nbytes)
+    {
+        if (scratch->data != NULL)
+            pfree(scratch->data);
+        /* grow geometrically to avoid reallocating for every longer document */
+        nbytes = Max(nbytes, 2 * scratch->size);
+        scratch->data = (char *) MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+            nbytes);
+        scratch->size = nbytes;
+    }
+    return scratch->data;
+}
+
+/*
+ * Validate the arguments shared by all decoders and return the document
+ * length.
+ */
+static int
+viterbi_check_args(ArrayType *marray, ArrayType *rarray, int nlabel)
+{
+    int mlen, rlen;
+
+    if (nlabel <= 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of labels must be positive")));
+    if (ARR_NDIM(marray) != 1 || ARR_NDIM(rarray) != 1 ||
+        ARR_HASNULL(marray) || ARR_HASNULL(rarray))
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("factor arrays must be one-dimensional without NULLs")));
+
+    mlen = ARR_DIMS(marray)[0];
+    rlen = ARR_DIMS(rarray)[0];
+    if (mlen < (nlabel + 2) * nlabel)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("m factor array must have (nlabel+2)*nlabel entries")));
+    if (rlen % nlabel != 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("r factor array must have doclen*nlabel entries")));
+    return rlen / nlabel;
+}
+
+/*
+ * Compute z = log(exp(x) + exp(y)) on scores scaled by 1000. The correction
+ * term is computed as log(1 + exp(-|x-y|)), which cannot overflow.
+ * 0.5 is for rounding.
+ */
+static inline int
+log_sum_exp(int x, int y)
+{
+    int diff = abs(x - y);
+
+    return Max(x, y) + (int) (log1p(exp(-diff / 1000.0)) * 1000.0 + 0.5);
+}
+
+/*
+ * Compute the per-position bias that does not depend on the previous label:
+ * the state feature of the current token plus, for the last token, the end
+ * feature. Hoisting it keeps the inner loops free of position checks.
+ */
+static inline void
+viterbi_bias(const int *mArray, const int *rArray, int nlabel, int doclen,
+             int start_pos, int *bias)
+{
+    const int  *r = rArray + start_pos * nlabel;
+    const int  *end = END_FACTORS(mArray, nlabel);
+    int         label;
+
+    if (start_pos == doclen - 1)
+        for (label = 0; label < nlabel; label++)
+            bias[label] = r[label] + end[label];
+    else
+        for (label = 0; label < nlabel; label++)
+            bias[label] = r[label];
+}
+
+/*
+ * Compute the normalization factor, i.e., the log of the sum over all label
+ * sequences of exp(score). The loops run over the current label innermost so
+ * that the additions stream through contiguous rows of the transition
+ * matrix.
+ */
+static int
+viterbi_norm(const int *mArray, const int *rArray, int nlabel, int doclen,
+             int *prev_norm_array, int *curr_norm_array, int *bias)
+{
+    const int  *trans = TRANS_FACTORS(mArray, nlabel);
+    const int  *start = START_FACTORS(mArray, nlabel);
+    int         start_pos, currlabel, prevlabel, norm_factor;
+    int        *tmp;
+
+    for (currlabel = 0; currlabel < nlabel; currlabel++)
+        prev_norm_array[currlabel] = rArray[currlabel] + start[currlabel];
+
+    for (start_pos = 1; start_pos < doclen; start_pos++)
+    {
+        viterbi_bias(mArray, rArray, nlabel, doclen, start_pos, bias);
+        for (currlabel = 0; currlabel < nlabel; currlabel++)
+            curr_norm_array[currlabel] = prev_norm_array[0] + trans[currlabel];
+        for (prevlabel = 1; prevlabel < nlabel; prevlabel++)
+        {
+            const int  *row = trans + prevlabel * nlabel;
+            int         prev_score = prev_norm_array[prevlabel];
+
+            for (currlabel = 0; currlabel < nlabel; currlabel++)
+                curr_norm_array[currlabel] = log_sum_exp(
+                    curr_norm_array[currlabel], prev_score + row[currlabel]);
+        }
+        for (currlabel = 0; currlabel < nlabel; currlabel++)
+            curr_norm_array[currlabel] += bias[currlabel];
+
+        tmp = prev_norm_array;
+        prev_norm_array = curr_norm_array;
+        curr_norm_array = tmp;
+    }
+
+    norm_factor = prev_norm_array[0];
+    for (currlabel = 1; currlabel < nlabel; currlabel++)
+        norm_factor = log_sum_exp(norm_factor, prev_norm_array[currlabel]);
+    return norm_factor;
+}
+
+/*
+ * One max-plus step of the top-1 Viterbi recursion. For every current label,
+ * find the first previous label that maximizes the score. The inner loop over
+ * the current label is branch-free and runs over contiguous memory, so that
+ * the compiler can vectorize it.
+ *
+ * Scores that are not positive are reset to 0 (with back-pointer 0), which is
+ * what the decoder has always done.
+ */
+static void
+viterbi_top1_step(const int *trans, const int *prev_top1_array,
+                  const int *bias, int nlabel, int *curr_top1_array,
+                  int *path)
+{
+    int prevlabel, currlabel;
+
+    for (currlabel = 0; currlabel < nlabel; currlabel++)
+    {
+        curr_top1_array[currlabel] = prev_top1_array[0] + trans[currlabel];
+        path[currlabel] = 0;
+    }
+    for (prevlabel = 1; prevlabel < nlabel; prevlabel++)
+    {
+        const int  *row = trans + prevlabel * nlabel;
+        int         prev_score = prev_top1_array[prevlabel];
+
+        for (currlabel = 0; currlabel < nlabel; currlabel++)
+        {
+            int     score = prev_score + row[currlabel];
+            bool    better = score > curr_top1_array[currlabel];
+
+            curr_top1_array[currlabel] = better ? score : curr_top1_array[currlabel];
+            path[currlabel] = better ? prevlabel : path[currlabel];
+        }
+    }
+    for (currlabel = 0; currlabel < nlabel; currlabel++)
+    {
+        int     score = curr_top1_array[currlabel] + bias[currlabel];
+
+        curr_top1_array[currlabel] = score > 0 ? score : 0;
+        path[currlabel] = score > 0 ? path[currlabel] : 0;
+    }
+}
+
 PG_FUNCTION_INFO_V1(vcrf_top1_label);
 
 Datum
 vcrf_top1_label(PG_FUNCTION_ARGS)
 {
-	ArrayType *result;
-        int *prev_top1_array, *curr_top1_array, *prev_norm_array, *curr_norm_array, *path, *mArray, *rArray;
-        int ndatabytes, nbytes, norm_factor, i;
-        int start_pos, label, currlabel, prevlabel, doclen, nlabel;
-        Oid     element_type;
-        mArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(0));
-        element_type = ARR_ELEMTYPE(PG_GETARG_ARRAYTYPE_P(0));        
-        rArray = (int*)ARR_DATA_PTR(PG_GETARG_ARRAYTYPE_P(1));
-        nlabel = PG_GETARG_INT32(2);
-        doclen = ARR_DIMS(PG_GETARG_ARRAYTYPE_P(1))[0]/nlabel;
-        // initialize the four temporary arrays
-        ndatabytes = sizeof(int) * nlabel;
-        prev_top1_array = (int*) palloc0(ndatabytes);
-        curr_top1_array = (int*) palloc0(ndatabytes);
-        prev_norm_array = (int*) palloc0(ndatabytes);
-        curr_norm_array = (int*) palloc0(ndatabytes);
-        
-        // define the path
-        nbytes = doclen*nlabel*sizeof(int); 
-        path = (int*)palloc0(nbytes);
-        
-        // define the output, the first doclen elements are to store the best label sequence
-        // the last two elements are used to calculate the probability.
-        result = (ArrayType *) palloc(sizeof(int)*(doclen+1) + ARR_OVERHEAD_NONULLS(1));
-        SET_VARSIZE(result, sizeof(int)*(doclen+1) + ARR_OVERHEAD_NONULLS(1));
-        result->ndim = 1;
-        result->dataoffset = 0;
-        result->elemtype = element_type;
-        ARR_DIMS(result)[0] = doclen+1; 
-        ARR_LBOUND(result)[0] = 1;
-        for(start_pos=0;start_pos<doclen;start_pos++){
-            memset(curr_top1_array, 0, nlabel*sizeof(int));
-            memset(curr_norm_array, 0, nlabel*sizeof(int));
-            if (start_pos == 0){// the first token in a sentence, the start feature to be fired.
-               for(int label=0; label<nlabel; label++){
-                  curr_norm_array[label] = rArray[start_pos*nlabel+label] + mArray[label]; 
-                  curr_top1_array[label] = rArray[start_pos*nlabel+label] + mArray[label]; 
-               }
-            } else {
-                    for(currlabel=0; currlabel<nlabel; currlabel++){
-                       for(prevlabel=0; prevlabel<nlabel; prevlabel++){
-                          // calculate the best label sequence
-                          int top1_new_score = prev_top1_array[prevlabel] + rArray[start_pos*nlabel+currlabel] +
-                                               mArray[(prevlabel+1)*nlabel+currlabel];
-                          // the last token in a sentence, the end feature should be fired 
-                          if (start_pos == doclen-1){
-                             top1_new_score += mArray[(nlabel+1)*nlabel+currlabel];
-                          }
-                          if(top1_new_score > curr_top1_array[currlabel]){
-                             curr_top1_array[currlabel] = top1_new_score;
-                             path[start_pos*nlabel+currlabel] = prevlabel;
-                          }
-                          // calculate the probability of the best label sequence
-                          int norm_new_score = prev_norm_array[prevlabel] + rArray[start_pos*nlabel+currlabel] +
-                                               mArray[(prevlabel+1)*nlabel+currlabel];
-                          // the last token in a sentence, the end feature should be fired 
-                          if(start_pos == doclen-1){
-                              norm_new_score += mArray[(nlabel+1)*nlabel+currlabel];
-                          }  
-                          // the following wants to do z=log(exp(x)+exp(y)), the faster implementation is 
-                          // z=min(x,y) + log(exp(abs(x-y))+1)
-                          // 0.5 is for rounding
-                          if (curr_norm_array[currlabel] == 0){
-                              curr_norm_array[currlabel] = norm_new_score;
-                          } else {
-                              curr_norm_array[currlabel] = min(curr_norm_array[currlabel], norm_new_score) + 
-                              (int)(log(exp(abs(norm_new_score - curr_norm_array[currlabel])/1000.0) + 1)*1000.0 + 0.5);
-                          }
-                       } 
-                   }
-            }
-            for(label=0; label<nlabel; label++){
-                       prev_top1_array[label] = curr_top1_array[label];
-                       prev_norm_array[label] = curr_norm_array[label];
-            }
-        }
-        // find the label of the last token in a sentence
-        int top1label = 0;
-        int maxscore =0;
-        int pos =0;
-        for(label=0; label<nlabel; label++){
-               if(curr_top1_array[label]>maxscore){
-	          maxscore = curr_top1_array[label];
-                  top1label = label;
-               }
+    ArrayType  *marray = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType  *rarray = PG_GETARG_ARRAYTYPE_P(1);
+    int         nlabel = PG_GETARG_INT32(2);
+    ArrayType  *result;
+    const int  *mArray, *rArray, *start;
+    int        *prev_top1_array, *curr_top1_array, *prev_norm_array,
+               *curr_norm_array, *bias, *path, *labels, *tmp;
+    int         doclen, start_pos, label, norm_factor, top1label, maxscore, pos;
+
+    doclen = viterbi_check_args(marray, rarray, nlabel);
+    mArray = (const int *) ARR_DATA_PTR(marray);
+    rArray = (const int *) ARR_DATA_PTR(rarray);
+    start = START_FACTORS(mArray, nlabel);
+
+    // the five per-label arrays and the path, all reused across calls
+    prev_top1_array = (int *) viterbi_scratch(fcinfo,
+        sizeof(int) * nlabel * (5 + Max(doclen, 1)));
+    curr_top1_array = prev_top1_array + nlabel;
+    prev_norm_array = curr_top1_array + nlabel;
+    curr_norm_array = prev_norm_array + nlabel;
+    bias = curr_norm_array + nlabel;
+    path = bias + nlabel;
+
+    // define the output, the first doclen elements are to store the best label sequence
+    // the last element is used to calculate the probability.
+    result = (ArrayType *) palloc0(sizeof(int)*(doclen+1) + ARR_OVERHEAD_NONULLS(1));
+    SET_VARSIZE(result, sizeof(int)*(doclen+1) + ARR_OVERHEAD_NONULLS(1));
+    result->ndim = 1;
+    result->dataoffset = 0;
+    result->elemtype = ARR_ELEMTYPE(marray);
+    ARR_DIMS(result)[0] = doclen+1;
+    ARR_LBOUND(result)[0] = 1;
+    labels = (int *) ARR_DATA_PTR(result);
+    if (doclen == 0)
+        PG_RETURN_ARRAYTYPE_P(result);
+
+    // the first token in a sentence, the start feature to be fired.
+    for (label = 0; label < nlabel; label++)
+    {
+        prev_top1_array[label] = rArray[label] + start[label];
+        path[label] = 0;
+    }
+    for (start_pos = 1; start_pos < doclen; start_pos++)
+    {
+        viterbi_bias(mArray, rArray, nlabel, doclen, start_pos, bias);
+        viterbi_top1_step(TRANS_FACTORS(mArray, nlabel), prev_top1_array, bias,
+            nlabel, curr_top1_array, path + start_pos * nlabel);
+        tmp = prev_top1_array;
+        prev_top1_array = curr_top1_array;
+        curr_top1_array = tmp;
+    }
+
+    // find the label of the last token in a sentence
+    top1label = 0;
+    maxscore = 0;
+    for (label = 0; label < nlabel; label++)
+    {
+        if (prev_top1_array[label] > maxscore)
+        {
+            maxscore = prev_top1_array[label];
+            top1label = label;
         }
-        // trace back to get the labels for the rest tokens in a sentence
-        ((int*)ARR_DATA_PTR(result))[doclen-1] = top1label;
-        for (pos=doclen-1; pos>=1; pos--){
-            top1label = path[pos*nlabel+top1label];  
-            ((int*)ARR_DATA_PTR(result))[pos-1] = top1label;           
+    }
+    // trace back to get the labels for the rest tokens in a sentence
+    labels[doclen-1] = top1label;
+    for (pos = doclen-1; pos >= 1; pos--)
+    {
+        top1label = path[pos*nlabel+top1label];
+        labels[pos-1] = top1label;
+    }
+
+    norm_factor = viterbi_norm(mArray, rArray, nlabel, doclen,
+        prev_norm_array, curr_norm_array, bias);
+    // calculate the conditional probability.
+    // to convert the probability into integer, firstly,let it multiply 1000000, then later make the product divided by 1000000
+    // to get the real conditional probability
+    labels[doclen] = (int)(exp((maxscore - norm_factor)/1000.0)*1000000);
+
+    PG_RETURN_ARRAYTYPE_P(result);
+}
+
+/*
+ * Insert a candidate into a list of at most k scores that is sorted in
+ * descending order. Ties are resolved in favor of the candidate inserted
+ * first. Returns false if the candidate did not make it into the list.
+ */
+static inline bool
+topk_insert(int *scores, int *backs, int *count, int k, int score, int back)
+{
+    int pos = *count;
+
+    if (pos == k)
+    {
+        if (score <= scores[k - 1])
+            return false;
+        pos--;
+    }
+    else
+        (*count)++;
+
+    while (pos > 0 && scores[pos - 1] < score)
+    {
+        scores[pos] = scores[pos - 1];
+        backs[pos] = backs[pos - 1];
+        pos--;
+    }
+    scores[pos] = score;
+    backs[pos] = back;
+    return true;
+}
+
+/**
+ * @brief Find the k most probable label sequences using the list Viterbi
+ *        algorithm
+ * @param marray  Encode the edge feature, start feature and end feature
+ * @param rarray  Encode the single state feature, e.g, word feature, regex feature.
+ * @param nlabel Total number of labels in the label space
+ * @param k Number of label sequences to return
+ * @return A two-dimensional array with one row per label sequence, ordered by
+ *         decreasing score. Each row contains the doclen labels followed by the
+ *         conditional probability multiplied by 1000000. There are fewer than
+ *         k rows if there are fewer than k distinct label sequences.
+ *
+ * For every position and label, the k best partial sequences ending in that
+ * label are kept, together with back-pointers (previous label and rank).
+ * Scores are exact; unlike vcrf_top1_label, they are not clipped at zero.
+ **/
+PG_FUNCTION_INFO_V1(vcrf_topk_label);
+
+Datum
+vcrf_topk_label(PG_FUNCTION_ARGS)
+{
+    ArrayType  *marray = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType  *rarray = PG_GETARG_ARRAYTYPE_P(1);
+    int         nlabel = PG_GETARG_INT32(2);
+    int         k = PG_GETARG_INT32(3);
+    const int  *mArray, *rArray, *start, *trans;
+    int        *prev_scores, *curr_scores, *prev_count, *curr_count, *bias,
+               *norm_prev, *norm_curr, *back, *final_scores, *final_backs,
+               *tmp;
+    int         doclen, start_pos, currlabel, prevlabel, rank, nrows,
+                final_count, norm_factor, row, pos;
+    Datum      *elems;
+    int         dims[2], lbs[2];
+    int16       typlen;
+    bool        typbyval;
+    char        typalign;
+
+    doclen = viterbi_check_args(marray, rarray, nlabel);
+    if (k <= 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("number of label sequences must be positive")));
+    if (doclen == 0)
+        PG_RETURN_ARRAYTYPE_P(construct_empty_array(INT4OID));
+    if ((Size) doclen * nlabel * k >= MaxAllocSize / sizeof(int))
+        ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("too many label sequences requested")));
+
+    mArray = (const int *) ARR_DATA_PTR(marray);
+    rArray = (const int *) ARR_DATA_PTR(rarray);
+    start = START_FACTORS(mArray, nlabel);
+    trans = TRANS_FACTORS(mArray, nlabel);
+
+    prev_scores = (int *) viterbi_scratch(fcinfo,
+        sizeof(int) * ((Size) nlabel * k * (doclen + 2) + 5 * nlabel + 2 * k));
+    curr_scores = prev_scores + nlabel * k;
+    prev_count = curr_scores + nlabel * k;
+    curr_count = prev_count + nlabel;
+    bias = curr_count + nlabel;
+    norm_prev = bias + nlabel;
+    norm_curr = norm_prev + nlabel;
+    final_scores = norm_curr + nlabel;
+    final_backs = final_scores + k;
+    // back[(start_pos * nlabel + label) * k + rank] = prevlabel * k + prevrank
+    back = final_backs + k;
+
+    for (currlabel = 0; currlabel < nlabel; currlabel++)
+    {
+        prev_scores[currlabel * k] = rArray[currlabel] + start[currlabel];
+        prev_count[currlabel] = 1;
+    }
+    for (start_pos = 1; start_pos < doclen; start_pos++)
+    {
+        viterbi_bias(mArray, rArray, nlabel, doclen, start_pos, bias);
+        for (currlabel = 0; currlabel < nlabel; currlabel++)
+        {
+            int    *scores = curr_scores + currlabel * k;
+            int    *backs = back + (start_pos * nlabel + currlabel) * k;
+
+            curr_count[currlabel] = 0;
+            for (prevlabel = 0; prevlabel < nlabel; prevlabel++)
+            {
+                const int  *prev = prev_scores + prevlabel * k;
+                int         edge = trans[prevlabel * nlabel + currlabel];
+
+                // the previous lists are sorted, so stop at the first miss
+                for (rank = 0; rank < prev_count[prevlabel]; rank++)
+                    if (!topk_insert(scores, backs, &curr_count[currlabel], k,
+                                     prev[rank] + edge, prevlabel * k + rank))
+                        break;
+            }
+            for (rank = 0; rank < curr_count[currlabel]; rank++)
+                scores[rank] += bias[currlabel];
         }
-        // compute the sum_i of log(v1[i]/1000), return (e^sum)*1000
-        // used in the UDFs which needs marginalization e.g., normalization
-        // the following wants to do z=log(exp(x)+exp(y)), the faster implementation is 
-        // z=min(x,y) + log(exp(abs(x-y))+1)
-        norm_factor = 0;
-        for(i = 0; i < nlabel; i++) {
-            if(i == 0) {
-               norm_factor = curr_norm_array[0];
-            } else {
-               norm_factor = min(curr_norm_array[i], norm_factor) +
-                             (int)(log(exp(abs(norm_factor - curr_norm_array[i])/1000.0) + 1)*1000.0 + 0.5);
-            } 
+        tmp = prev_scores;
+        prev_scores = curr_scores;
+        curr_scores = tmp;
+        tmp = prev_count;
+        prev_count = curr_count;
+        curr_count = tmp;
+    }
+
+    // merge the per-label lists of the last token
+    final_count = 0;
+    for (currlabel = 0; currlabel < nlabel; currlabel++)
+        for (rank = 0; rank < prev_count[currlabel]; rank++)
+            if (!topk_insert(final_scores, final_backs, &final_count, k,
+                             prev_scores[currlabel * k + rank],
+                             currlabel * k + rank))
+                break;
+    nrows = final_count;
+
+    norm_factor = viterbi_norm(mArray, rArray, nlabel, doclen, norm_prev,
+        norm_curr, bias);
+
+    // trace back every sequence
+    elems = (Datum *) palloc(sizeof(Datum) * nrows * (doclen + 1));
+    for (row = 0; row < nrows; row++)
+    {
+        Datum  *out = elems + row * (doclen + 1);
+        int     code = final_backs[row];
+
+        for (pos = doclen - 1; pos >= 0; pos--)
+        {
+            currlabel = code / k;
+            out[pos] = Int32GetDatum(currlabel);
+            if (pos > 0)
+                code = back[(pos * nlabel + currlabel) * k + code % k];
         }
-        // calculate the conditional probability.
-        // to convert the probability into integer, firstly,let it multiply 1000000, then later make the product divided by 1000000
-        // to get the real conditional probability
-        ((int*)ARR_DATA_PTR(result))[doclen] = (int)(exp((maxscore - norm_factor)/1000.0)*1000000);
+        out[doclen] = Int32GetDatum(
+            (int) (exp((final_scores[row] - norm_factor) / 1000.0) * 1000000));
+    }
 
-        PG_RETURN_ARRAYTYPE_P(result);
+    dims[0] = nrows;
+    dims[1] = doclen + 1;
+    lbs[0] = lbs[1] = 1;
+    get_typlenbyvalalign(INT4OID, &typlen, &typbyval, &typalign);
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(elems, NULL, 2, dims, lbs,
+        INT4OID, typlen, typbyval, typalign));
 }
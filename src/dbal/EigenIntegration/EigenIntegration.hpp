@@ -85,6 +85,63 @@ static isfinite(const Eigen::MatrixBase<Derived>& mat) {
     return mat.is_finite();
 }
 
+// Packed storage of symmetric matrices: Only the lower triangle is stored,
+// column by column (column j holds rows j, ..., n - 1). This halves the size
+// of transition states holding a Hessian, and every column of the triangle is
+// a contiguous segment.
+
+/**
+ * @brief Number of elements in the packed lower triangle of an n x n matrix
+ */
+inline
+Index
+packedTriangleSize(Index n) {
+    return n * (n + 1) / 2;
+}
+
+/**
+ * @brief Position of element (i, j), i >= j, in a packed lower triangle
+ */
+inline
+Index
+packedIndex(Index n, Index i, Index j) {
+    return j * n - j * (j - 1) / 2 + (i - j);
+}
+
+/**
+ * @brief Symmetric rank-1 update <tt>L += alpha * x * x^T</tt> of a packed
+ *     lower triangle
+ */
+template <typename PackedDerived, typename Derived>
+inline
+void
+static packedRankUpdate(Eigen::MatrixBase<PackedDerived>& packed,
+    const Eigen::MatrixBase<Derived>& x, double alpha = 1.) {
+
+    const Index n = x.size();
+    Index offset = 0;
+    for (Index j = 0; j < n; offset += n - j, j++)
+        packed.segment(offset, n - j) += (alpha * x(j)) * x.tail(n - j);
+}
+
+/**
+ * @brief Expand a packed lower triangle into a full symmetric matrix
+ */
+template <typename PackedDerived>
+inline
+Eigen::MatrixXd
+static unpackSymmetric(const Eigen::MatrixBase<PackedDerived>& packed,
+    Index n) {
+
+    Eigen::MatrixXd mat(n, n);
+    Index offset = 0;
+    for (Index j = 0; j < n; offset += n - j, j++) {
+        mat.col(j).tail(n - j) = packed.segment(offset, n - j);
+        mat.row(j).tail(n - j) = packed.segment(offset, n - j).transpose();
+    }
+    return mat;
+}
+
 } // namespace eigen_integration
 
 } // namespace dbal
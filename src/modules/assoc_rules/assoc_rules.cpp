@@ -2,7 +2,7 @@
  *
  * @file assoc_rules.cpp
  *
- * @brief Functions for Apriori algorithm in MADlib
+ * @brief Functions for association rules (FP-Growth) in MADlib
  *
  * @date August 1, 2012
  *//* ----------------------------------------------------------------------- */
@@ -10,6 +10,12 @@
 
 #include <dbconnector/dbconnector.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
 #include "assoc_rules.hpp"
 
 namespace madlib {
@@ -17,6 +23,7 @@ namespace modules {
 namespace assoc_rules {
 
 using madlib::dbconnector::postgres::madlib_get_typlenbyvalalign;
+using madlib::dbconnector::postgres::madlib_construct_array;
 typedef struct perm_fctx
 {
     bool*    flags;
@@ -161,11 +168,671 @@ gen_rules_from_cfp::SRF_next(void *user_fctx, bool *is_last_call) {
     ArrayHandle<text*> arr(construct_array(result, 2, TEXTOID,
             myfctx->typlen, myfctx->typbyval, myfctx->typalign));
 
+    // construct_array and cstring_to_text copied everything
+    delete[] pre_text;
+    delete[] post_text;
+    delete[] result;
+
     --myfctx->num_calls;
     *is_last_call = false;
     return arr;
 }
 
+
+/**
+ * @brief FP-tree of encoded transactions, stored in a byte string
+ *
+ * Items are positive integers, numbered in descending order of their
+ * frequency. Every transaction is inserted as the path of its items in
+ * ascending order, so that frequent items share the nodes close to the root.
+ *
+ * Byte string layout:
+ * - Header: numNodes (number of nodes, including the root) and capacity
+ *   (number of nodes that fit into the byte string), as int64
+ * - Nodes: the item, the parent, the first child and the next sibling (as
+ *   int32), and the count (as int64). The root is node 0, which is also used
+ *   as the "no node" marker for children and siblings.
+ *
+ * The byte string grows by doubling, up to the maximum size of a database
+ * value. Note: We assume that the byte string is initialized by the database
+ * as empty.
+ */
+template <class Handle>
+class FPTreeState {
+    template <class OtherHandle>
+    friend class FPTreeState;
+
+public:
+    enum { InitialCapacity = 1024 };
+
+    struct Header {
+        int64_t numNodes;
+        int64_t capacity;
+    };
+
+    struct Node {
+        int32_t item;
+        int32_t parent;
+        int32_t firstChild;
+        int32_t nextSibling;
+        int64_t count;
+    };
+
+    FPTreeState(const AnyType &inByteString)
+      : mStorage(inByteString.getAs<Handle>()) { }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    inline uint64_t numNodes() const {
+        return mStorage.size() == 0 ? 0
+            : static_cast<uint64_t>(header().numNodes);
+    }
+
+    inline const Node &node(uint64_t inNode) const {
+        return nodes()[inNode];
+    }
+
+    /**
+     * @brief Size of the byte string for the given number of nodes
+     */
+    static inline size_t byteSize(uint64_t inCapacity) {
+        return sizeof(Header) + sizeof(Node) * inCapacity;
+    }
+
+    /**
+     * @brief Initialize the state with a tree that only has a root.
+     *
+     * This function is only called for the first row.
+     */
+    void initialize(const Allocator &inAllocator) {
+        mStorage = inAllocator.allocateByteString<dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(byteSize(InitialCapacity));
+        header().numNodes = 1;
+        header().capacity = InitialCapacity;
+    }
+
+    /**
+     * @brief Insert a path of items (in ascending order) with the given count
+     */
+    template <class Iterator>
+    void insert(const Allocator &inAllocator, Iterator inBegin,
+        Iterator inEnd, int64_t inCount) {
+
+        int32_t current = 0;
+        for (Iterator it = inBegin; it != inEnd; ++it) {
+            int32_t item = *it;
+            int32_t child = nodes()[current].firstChild;
+            while (child != 0 && nodes()[child].item != item)
+                child = nodes()[child].nextSibling;
+            if (child == 0)
+                child = addNode(inAllocator, current, item);
+            nodes()[child].count += inCount;
+            current = child;
+        }
+    }
+
+    /**
+     * @brief Merge with another State object
+     *
+     * Every path of the other tree is inserted with the number of
+     * transactions that end at its last node.
+     */
+    template <class OtherHandle>
+    void merge(const Allocator &inAllocator,
+        const FPTreeState<OtherHandle> &inOtherState) {
+
+        uint64_t n = inOtherState.numNodes();
+        std::vector<int64_t> ownCount(n);
+        for (uint64_t i = 1; i < n; i++)
+            ownCount[i] = inOtherState.node(i).count;
+        for (uint64_t i = 1; i < n; i++)
+            ownCount[inOtherState.node(i).parent] -= inOtherState.node(i).count;
+
+        std::vector<int32_t> path;
+        for (uint64_t i = 1; i < n; i++) {
+            if (ownCount[i] <= 0)
+                continue;
+            path.clear();
+            for (int32_t p = static_cast<int32_t>(i); p != 0;
+                p = inOtherState.node(p).parent)
+                path.push_back(inOtherState.node(p).item);
+            insert(inAllocator, path.rbegin(), path.rend(), ownCount[i]);
+        }
+    }
+
+private:
+    /**
+     * @brief Maximum number of nodes: The byte string must not exceed the
+     *     maximum size of a database value, and nodes are referenced as int32
+     */
+    static inline uint64_t maxNodes() {
+        return std::min<uint64_t>(
+            (MaxAllocSize - ByteString::kEffectiveHeaderSize - sizeof(Header))
+                / sizeof(Node),
+            std::numeric_limits<int32_t>::max());
+    }
+
+    inline const Header &header() const {
+        return *reinterpret_cast<const Header*>(mStorage.ptr());
+    }
+
+    inline Header &header() {
+        return *reinterpret_cast<Header*>(mStorage.ptr());
+    }
+
+    inline const Node *nodes() const {
+        return reinterpret_cast<const Node*>(mStorage.ptr() + sizeof(Header));
+    }
+
+    inline Node *nodes() {
+        return reinterpret_cast<Node*>(mStorage.ptr() + sizeof(Header));
+    }
+
+    int32_t addNode(const Allocator &inAllocator, int32_t inParent,
+        int32_t inItem) {
+
+        uint64_t n = numNodes();
+        if (n == static_cast<uint64_t>(header().capacity)) {
+            uint64_t capacity = std::min(2 * n, maxNodes());
+            if (capacity <= n)
+                throw std::runtime_error("The FP-tree exceeds the maximum "
+                    "size of a database value. Use a higher minimum "
+                    "support.");
+
+            Handle oldStorage = mStorage;
+            mStorage = inAllocator.allocateByteString<dbal::AggregateContext,
+                dbal::DoZero, dbal::ThrowBadAlloc>(byteSize(capacity));
+            std::copy(oldStorage.ptr(), oldStorage.ptr() + oldStorage.size(),
+                mStorage.ptr());
+            header().capacity = static_cast<int64_t>(capacity);
+        }
+
+        int32_t added = static_cast<int32_t>(n);
+        header().numNodes = static_cast<int64_t>(n + 1);
+        nodes()[added].item = inItem;
+        nodes()[added].parent = inParent;
+        nodes()[added].nextSibling = nodes()[inParent].firstChild;
+        nodes()[inParent].firstChild = added;
+        return added;
+    }
+
+    Handle mStorage;
+};
+
+/**
+ * @brief Perform the FP-tree transition step
+ */
+AnyType
+fptree_transition::run(AnyType &args) {
+    FPTreeState<MutableByteString> state = args[0];
+    ArrayHandle<int32_t> items = args[1].getAs<ArrayHandle<int32_t> >();
+
+    std::vector<int32_t> path(items.ptr(), items.ptr() + items.size());
+    std::sort(path.begin(), path.end());
+    path.erase(std::unique(path.begin(), path.end()), path.end());
+    if (!path.empty() && path.front() < 1)
+        throw std::invalid_argument("Item IDs must be positive.");
+
+    if (state.numNodes() == 0)
+        state.initialize(*this);
+    state.insert(*this, path.begin(), path.end(), 1);
+    return state;
+}
+
+/**
+ * @brief Perform the FP-tree merge step
+ */
+AnyType
+fptree_merge_states::run(AnyType &args) {
+    FPTreeState<MutableByteString> stateLeft = args[0];
+    FPTreeState<ByteString> stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numNodes() == 0)
+        return stateRight;
+    else if (stateRight.numNodes() == 0)
+        return stateLeft;
+
+    stateLeft.merge(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the FP-tree final step
+ *
+ * The unused capacity is cut off.
+ */
+AnyType
+fptree_final::run(AnyType &args) {
+    typedef FPTreeState<ByteString> State;
+
+    State state = args[0];
+    ByteString storage = args[0].getAs<ByteString>();
+    uint64_t numNodes = state.numNodes();
+
+    if (numNodes == 0)
+        return Null();
+
+    MutableByteString tree = allocateByteString<dbal::FunctionContext,
+        dbal::DoNotZero, dbal::ThrowBadAlloc>(State::byteSize(numNodes));
+    std::copy(storage.ptr(), storage.ptr() + State::byteSize(numNodes),
+        tree.ptr());
+    reinterpret_cast<State::Header*>(tree.ptr())->capacity
+        = static_cast<int64_t>(numNodes);
+    return tree;
+}
+
+namespace {
+
+/**
+ * @brief In-memory FP-tree used for mining frequent itemsets
+ */
+class FPTree {
+public:
+    explicit FPTree(int32_t inMaxItem)
+      : mNodesOfItem(inMaxItem + 1) {
+
+        addNode(0, 0);
+    }
+
+    /**
+     * @brief Insert a path of items (in ascending order) with the given count
+     */
+    void insert(const std::vector<int32_t> &inPath, double inCount) {
+        int32_t node = 0;
+        for (size_t k = 0; k < inPath.size(); k++) {
+            int32_t child = mFirstChild[node];
+            while (child != 0 && mItem[child] != inPath[k])
+                child = mNextSibling[child];
+            if (child == 0)
+                child = addNode(node, inPath[k]);
+            mCount[child] += inCount;
+            node = child;
+        }
+    }
+
+    /**
+     * @brief Append all itemsets with at least the given count that consist
+     *     of the given suffix and items of this tree
+     *
+     * Each itemset is appended as its count, followed by its items in
+     * ascending order.
+     */
+    void mine(std::vector<int32_t> &ioSuffix, double inMinCount,
+        std::vector<double> &outItemsets,
+        std::vector<size_t> &outOffsets) const {
+
+        int32_t maxItem = static_cast<int32_t>(mNodesOfItem.size()) - 1;
+        for (int32_t item = maxItem; item >= 1; item--) {
+            const std::vector<int32_t> &nodes = mNodesOfItem[item];
+            double support = 0;
+            for (size_t k = 0; k < nodes.size(); k++)
+                support += mCount[nodes[k]];
+            if (nodes.empty() || support < inMinCount)
+                continue;
+
+            ioSuffix.push_back(item);
+            outOffsets.push_back(outItemsets.size());
+            outItemsets.push_back(support);
+            for (size_t k = ioSuffix.size(); k > 0; k--)
+                outItemsets.push_back(ioSuffix[k - 1]);
+
+            // The conditional pattern base of item consists of the paths
+            // leading to its nodes. Only smaller items occur on these paths.
+            std::vector<double> itemCount(item, 0.);
+            bool anyFrequent = false;
+            for (size_t k = 0; k < nodes.size(); k++)
+                for (int32_t p = mParent[nodes[k]]; p != 0; p = mParent[p])
+                    itemCount[mItem[p]] += mCount[nodes[k]];
+            for (int32_t i = 1; i < item && !anyFrequent; i++)
+                anyFrequent = itemCount[i] >= inMinCount;
+
+            if (anyFrequent) {
+                FPTree conditional(item - 1);
+                std::vector<int32_t> path;
+                for (size_t k = 0; k < nodes.size(); k++) {
+                    path.clear();
+                    for (int32_t p = mParent[nodes[k]]; p != 0; p = mParent[p])
+                        if (itemCount[mItem[p]] >= inMinCount)
+                            path.push_back(mItem[p]);
+                    std::reverse(path.begin(), path.end());
+                    conditional.insert(path, mCount[nodes[k]]);
+                }
+                conditional.mine(ioSuffix, inMinCount, outItemsets,
+                    outOffsets);
+            }
+            ioSuffix.pop_back();
+        }
+    }
+
+private:
+    int32_t addNode(int32_t inParent, int32_t inItem) {
+        int32_t node = static_cast<int32_t>(mItem.size());
+        mItem.push_back(inItem);
+        mCount.push_back(0);
+        mParent.push_back(inParent);
+        mFirstChild.push_back(0);
+        mNextSibling.push_back(node == 0 ? 0 : mFirstChild[inParent]);
+        if (node != 0) {
+            mFirstChild[inParent] = node;
+            mNodesOfItem[inItem].push_back(node);
+        }
+        return node;
+    }
+
+    std::vector<int32_t> mItem;
+    std::vector<double> mCount;
+    std::vector<int32_t> mParent;
+    std::vector<int32_t> mFirstChild;
+    std::vector<int32_t> mNextSibling;
+    std::vector<std::vector<int32_t> > mNodesOfItem;
+};
+
+/**
+ * @brief The frequent itemsets of an FP-tree, with a hash index on their items
+ *
+ * Each itemset is stored as its count, followed by its items in ascending
+ * order. The index is an open-addressing hash table (linear probing) of
+ * itemset numbers plus one, so that 0 marks an empty slot.
+ */
+class FrequentItemsets {
+public:
+    /**
+     * @brief Mine the frequent itemsets of the FP-tree stored in inTree
+     */
+    FrequentItemsets(const FPTreeState<ByteString> &inTree,
+        double inMinCount) {
+
+        // rebuild the tree in memory, inserting every path with the number
+        // of transactions ending at its last node
+        uint64_t n = inTree.numNodes();
+        int32_t maxItem = 0;
+        std::vector<double> ownCount(n);
+        for (uint64_t i = 1; i < n; i++) {
+            maxItem = std::max(maxItem, inTree.node(i).item);
+            ownCount[i] += static_cast<double>(inTree.node(i).count);
+            ownCount[inTree.node(i).parent]
+                -= static_cast<double>(inTree.node(i).count);
+        }
+
+        FPTree tree(maxItem);
+        std::vector<int32_t> path;
+        for (uint64_t i = 1; i < n; i++) {
+            if (ownCount[i] <= 0)
+                continue;
+            path.clear();
+            for (int32_t p = static_cast<int32_t>(i); p != 0;
+                p = inTree.node(p).parent)
+                path.push_back(inTree.node(p).item);
+            std::reverse(path.begin(), path.end());
+            tree.insert(path, ownCount[i]);
+        }
+
+        std::vector<int32_t> suffix;
+        tree.mine(suffix, inMinCount, mItemsets, mOffsets);
+        mOffsets.push_back(mItemsets.size());
+    }
+
+    size_t size() const {
+        return mOffsets.size() - 1;
+    }
+
+    double count(size_t inItemset) const {
+        return mItemsets[mOffsets[inItemset]];
+    }
+
+    const double *items(size_t inItemset) const {
+        return &mItemsets[mOffsets[inItemset] + 1];
+    }
+
+    size_t numItems(size_t inItemset) const {
+        return mOffsets[inItemset + 1] - mOffsets[inItemset] - 1;
+    }
+
+    /**
+     * @brief Build the hash index. This is only needed for countOf().
+     */
+    void buildIndex() {
+        size_t capacity = 16;
+        while (capacity < 2 * size())
+            capacity *= 2;
+        mTable.assign(capacity, 0);
+        for (size_t i = 0; i < size(); i++) {
+            size_t pos = hash(items(i), numItems(i)) & (capacity - 1);
+            while (mTable[pos] != 0)
+                pos = (pos + 1) & (capacity - 1);
+            mTable[pos] = i + 1;
+        }
+    }
+
+    /**
+     * @brief Count of the given itemset (items in ascending order), or 0 if
+     *     it is not frequent
+     */
+    double countOf(const std::vector<double> &inItems) const {
+        size_t mask = mTable.size() - 1;
+        for (size_t pos = hash(&inItems[0], inItems.size()) & mask;
+            mTable[pos] != 0; pos = (pos + 1) & mask) {
+
+            size_t i = mTable[pos] - 1;
+            if (numItems(i) == inItems.size()
+                && std::equal(inItems.begin(), inItems.end(), items(i)))
+                return count(i);
+        }
+        return 0;
+    }
+
+private:
+    static size_t hash(const double *inItems, size_t inNumItems) {
+        uint64_t h = 0;
+        for (size_t k = 0; k < inNumItems; k++) {
+            h = (h ^ static_cast<uint64_t>(inItems[k])) * 0x9E3779B97F4A7C15ULL;
+            h ^= h >> 32;
+        }
+        return static_cast<size_t>(h);
+    }
+
+    std::vector<double> mItemsets;
+    std::vector<size_t> mOffsets;
+    std::vector<size_t> mTable;
+};
+
+} // anonymous namespace
+
+typedef struct fpgrowth_fctx
+{
+    FrequentItemsets    *itemsets;
+    size_t              next;
+
+    /* type information for the result type*/
+    int16               typlen;
+    bool                typbyval;
+    char                typalign;
+} fpgrowth_fctx;
+
+/**
+ * @brief   The init function for fpgrowth. All frequent itemsets are mined
+ *          here, and returned one by one by the next function.
+ *
+ * @param args      args[0] is the FP-tree built by the fptree aggregate.
+ *                  args[1] is the minimum number of transactions.
+ */
+void *
+fpgrowth::SRF_init(AnyType &args) {
+    FPTreeState<ByteString> tree = args[0];
+    double minCount = args[1].getAs<double>();
+
+    fpgrowth_fctx *myfctx = new fpgrowth_fctx();
+    myfctx->itemsets = new FrequentItemsets(tree, minCount);
+    myfctx->next = 0;
+
+    // return type id is FLOAT8OID, get the related information
+    madlib_get_typlenbyvalalign
+        (FLOAT8OID, &myfctx->typlen, &myfctx->typbyval, &myfctx->typalign);
+
+    return myfctx;
+}
+
+/**
+ * @brief The next function for fpgrowth.
+ *
+ * @return  An array whose first element is the number of transactions that
+ *          contain the itemset, followed by the items in ascending order.
+ */
+AnyType
+fpgrowth::SRF_next(void *user_fctx, bool *is_last_call) {
+    fpgrowth_fctx *myfctx = static_cast<fpgrowth_fctx*>(user_fctx);
+
+    if (!is_last_call)
+        throw std::invalid_argument("the paramter is_last_class should not be null");
+
+    if (myfctx->next >= myfctx->itemsets->size()) {
+        *is_last_call = true;
+        return Null();
+    }
+
+    size_t n = myfctx->itemsets->numItems(myfctx->next);
+    MutableArrayHandle<double> itemset(madlib_construct_array(NULL,
+        static_cast<int>(n + 1), FLOAT8OID,
+        myfctx->typlen, myfctx->typbyval, myfctx->typalign));
+    itemset[0] = myfctx->itemsets->count(myfctx->next);
+    std::copy(myfctx->itemsets->items(myfctx->next),
+        myfctx->itemsets->items(myfctx->next) + n, itemset.ptr() + 1);
+
+    myfctx->next++;
+    *is_last_call = false;
+    return itemset;
+}
+
+typedef struct rules_fctx
+{
+    FrequentItemsets    *itemsets;
+    double              num_tranx;
+    double              min_confidence;
+    size_t              itemset;
+    uint64_t            split;
+
+    /* type information for the item arrays */
+    int16               typlen;
+    bool                typbyval;
+    char                typalign;
+} rules_fctx;
+
+/**
+ * @brief   The init function for gen_rules_from_fptree.
+ *
+ * @param args      args[0] is the FP-tree built by the fptree aggregate.
+ *                  args[1] is the minimum number of transactions.
+ *                  args[2] is the total number of transactions.
+ *                  args[3] is the minimum confidence.
+ */
+void *
+gen_rules_from_fptree::SRF_init(AnyType &args) {
+    FPTreeState<ByteString> tree = args[0];
+    double minCount = args[1].getAs<double>();
+
+    rules_fctx *myfctx = new rules_fctx();
+    myfctx->itemsets = new FrequentItemsets(tree, minCount);
+    myfctx->itemsets->buildIndex();
+    myfctx->num_tranx = args[2].getAs<double>();
+    myfctx->min_confidence = args[3].getAs<double>();
+    myfctx->itemset = 0;
+    myfctx->split = 0;
+
+    // item arrays are INT4OID, get the related information
+    madlib_get_typlenbyvalalign
+        (INT4OID, &myfctx->typlen, &myfctx->typbyval, &myfctx->typalign);
+
+    return myfctx;
+}
+
+/**
+ * @brief The next function for gen_rules_from_fptree.
+ *
+ * Every frequent itemset of n > 1 items is split into antecedent and
+ * consequent in all 2^n - 2 possible ways. A split is the bitmask of the
+ * items that go to the antecedent. The supports of both parts are looked up
+ * in the hash index of the frequent itemsets (they are frequent, since the
+ * whole itemset is).
+ *
+ * @return  The antecedent and consequent item IDs, followed by the support,
+ *          confidence, lift and conviction of the next rule that meets the
+ *          minimum confidence.
+ */
+AnyType
+gen_rules_from_fptree::SRF_next(void *user_fctx, bool *is_last_call) {
+    rules_fctx *myfctx = static_cast<rules_fctx*>(user_fctx);
+    const FrequentItemsets &itemsets = *myfctx->itemsets;
+    std::vector<double> pre;
+    std::vector<double> post;
+
+    if (!is_last_call)
+        throw std::invalid_argument("the paramter is_last_class should not be null");
+
+    for (; myfctx->itemset < itemsets.size();
+        myfctx->itemset++, myfctx->split = 0) {
+
+        size_t n = itemsets.numItems(myfctx->itemset);
+        if (n < 2)
+            continue;
+        if (n >= 64)
+            throw std::runtime_error("Frequent itemsets of 64 or more items "
+                "are not supported.");
+
+        const double *items = itemsets.items(myfctx->itemset);
+        uint64_t lastSplit = (static_cast<uint64_t>(1) << n) - 2;
+        while (myfctx->split < lastSplit) {
+            uint64_t split = ++myfctx->split;
+            pre.clear();
+            post.clear();
+            for (size_t k = 0; k < n; k++)
+                (((split >> k) & 1) ? pre : post).push_back(items[k]);
+
+            double support_xy = itemsets.count(myfctx->itemset)
+                / myfctx->num_tranx;
+            double support_x = itemsets.countOf(pre) / myfctx->num_tranx;
+            double support_y = itemsets.countOf(post) / myfctx->num_tranx;
+            double confidence = support_xy / support_x;
+            if (confidence < myfctx->min_confidence)
+                continue;
+
+            MutableArrayHandle<int32_t> preIds(madlib_construct_array(NULL,
+                static_cast<int>(pre.size()), INT4OID,
+                myfctx->typlen, myfctx->typbyval, myfctx->typalign));
+            MutableArrayHandle<int32_t> postIds(madlib_construct_array(NULL,
+                static_cast<int>(post.size()), INT4OID,
+                myfctx->typlen, myfctx->typbyval, myfctx->typalign));
+            for (size_t k = 0; k < pre.size(); k++)
+                preIds[k] = static_cast<int32_t>(pre[k]);
+            for (size_t k = 0; k < post.size(); k++)
+                postIds[k] = static_cast<int32_t>(post[k]);
+
+            AnyType tuple;
+            tuple << preIds
+                  << postIds
+                  << support_xy
+                  << confidence
+                  << confidence / support_y
+                  << (std::fabs(confidence - 1) < 1.0E-10 ? 0.
+                        : (1 - support_y) / (1 - confidence));
+            *is_last_call = false;
+            return tuple;
+        }
+    }
+
+    *is_last_call = true;
+    return Null();
+}
+
 } // namespace assoc_rules
 
 } // namespace modules
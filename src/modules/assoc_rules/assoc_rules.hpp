@@ -29,3 +29,49 @@
  */
 DECLARE_SR_UDF(assoc_rules, gen_rules_from_cfp)
 
+
+/**
+ * @brief FP-tree of encoded transactions: Transition function
+ */
+DECLARE_UDF(assoc_rules, fptree_transition)
+
+/**
+ * @brief FP-tree of encoded transactions: State merge function
+ */
+DECLARE_UDF(assoc_rules, fptree_merge_states)
+
+/**
+ * @brief FP-tree of encoded transactions: Final function
+ */
+DECLARE_UDF(assoc_rules, fptree_final)
+
+/**
+ * @brief   Mine all frequent itemsets of an FP-tree with the FP-Growth
+ *          algorithm.
+ *
+ * @param arg 1     The FP-tree, as built by the fptree aggregate.
+ * @param arg 2     The minimum number of transactions containing an itemset.
+ *
+ * @return  A set of DOUBLE PRECISION arrays. Each array holds the number of
+ *          transactions containing a frequent itemset, followed by the item
+ *          IDs of the itemset in ascending order.
+ */
+DECLARE_SR_UDF(assoc_rules, fpgrowth)
+
+/**
+ * @brief   Generate the association rules of all frequent itemsets of an
+ *          FP-tree. Itemsets are handled as integer item IDs, the splits into
+ *          antecedent and consequent are enumerated as bitmasks, and the
+ *          supports of the parts are looked up in a hash index of the
+ *          frequent itemsets.
+ *
+ * @param arg 1     The FP-tree, as built by the fptree aggregate.
+ * @param arg 2     The minimum number of transactions containing an itemset.
+ * @param arg 3     The total number of transactions.
+ * @param arg 4     The minimum confidence of a rule.
+ *
+ * @return  A set of rules, each consisting of the antecedent and consequent
+ *          item IDs, the support, the confidence, the lift and the
+ *          conviction.
+ */
+DECLARE_SR_UDF(assoc_rules, gen_rules_from_fptree)
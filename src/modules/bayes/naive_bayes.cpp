@@ -0,0 +1,406 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.cpp
+ *
+ * @brief Single-pass naive Bayes training and classification
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <utils/Math.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "naive_bayes.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace bayes {
+
+/**
+ * @brief Transition state and model for naive Bayes
+ *
+ * All counts are kept in one open-addressing hash table (linear probing,
+ * load factor at most 1/2). Each slot is a column (class, attr, value, count)
+ * and is empty if and only if its count is 0. Class counts are stored with
+ * attr 0, attributes are numbered starting from 1. States of different
+ * segments are merged by adding up counts.
+ *
+ * The final function additionally stores the number of distinct values of
+ * each attribute and the sorted classes with their counts, so that
+ * classification needs only hash lookups.
+ */
+template <class Container>
+class NaiveBayesState
+  : public DynamicStruct<NaiveBayesState<Container>, Container> {
+
+public:
+    typedef DynamicStruct<NaiveBayesState, Container> Base;
+    MADLIB_DYNAMIC_STRUCT_TYPEDEFS;
+    typedef std::tuple<int32_t, MappedColumnVector> tuple_type;
+
+    enum { kClass = 0, kAttr = 1, kValue = 2, kCount = 3 };
+
+    NaiveBayesState(Init_type& inInitialization)
+      : Base(inInitialization) {
+
+        this->initialize();
+    }
+
+    /**
+     * @brief Bind all elements of the state to the data in the stream
+     */
+    void bind(ByteStream_type& inStream) {
+        inStream >> numRows >> numAttrs >> numClasses >> capacity
+            >> numEntries;
+
+        uint32_t actualNumAttrs = numAttrs.isNull()
+            ? 0 : static_cast<uint32_t>(numAttrs);
+        uint32_t actualNumClasses = numClasses.isNull()
+            ? 0 : static_cast<uint32_t>(numClasses);
+        uint32_t actualCapacity = capacity.isNull()
+            ? 0 : static_cast<uint32_t>(capacity);
+        inStream
+            >> entries.rebind(4, actualCapacity)
+            >> attrValueCounts.rebind(actualNumAttrs)
+            >> classes.rebind(actualNumClasses)
+            >> classCounts.rebind(actualNumClasses);
+    }
+
+    /**
+     * @brief Update the accumulation state
+     */
+    NaiveBayesState& operator<<(const tuple_type& inTuple) {
+        const int32_t& c = std::get<0>(inTuple);
+        const MappedColumnVector& x = std::get<1>(inTuple);
+
+        if (!dbal::eigen_integration::isfinite(x))
+            throw std::domain_error("Attribute values are not finite.");
+        else if (x.size() > std::numeric_limits<int32_t>::max())
+            throw std::domain_error("Number of attributes is too large.");
+
+        if (numRows == 0) {
+            numAttrs = static_cast<uint32_t>(x.size());
+            rehash(std::max(static_cast<uint32_t>(16),
+                utils::nextPowerOfTwo(static_cast<uint32_t>(
+                    4 * (x.size() + 1)))));
+        } else if (x.size() != static_cast<Index>(numAttrs)) {
+            throw std::invalid_argument("Inconsistent numbers of attributes.");
+        }
+
+        numRows++;
+        add(c, 0, 0, 1);
+        for (Index i = 0; i < x.size(); ++i)
+            add(c, static_cast<double>(i + 1), x(i), 1);
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another accumulation state
+     */
+    template <class OtherContainer>
+    NaiveBayesState& operator<<(const NaiveBayesState<OtherContainer>& inOther) {
+        if (inOther.numRows == 0)
+            return *this;
+        else if (numRows == 0) {
+            this->copy(inOther);
+            return *this;
+        } else if (numAttrs != inOther.numAttrs)
+            throw std::invalid_argument("Inconsistent numbers of attributes.");
+
+        for (Index j = 0; j < inOther.entries.cols(); ++j)
+            if (inOther.entries(kCount, j) != 0)
+                add(inOther.entries(kClass, j), inOther.entries(kAttr, j),
+                    inOther.entries(kValue, j), inOther.entries(kCount, j));
+        numRows += inOther.numRows;
+        return *this;
+    }
+
+    /**
+     * @brief Compute the per-attribute and per-class summaries of the model
+     */
+    void finalize() {
+        std::vector<std::pair<double, double> > classList;
+        std::set<std::pair<double, double> > attrValues;
+        for (Index j = 0; j < entries.cols(); ++j) {
+            if (entries(kCount, j) == 0)
+                continue;
+            else if (entries(kAttr, j) == 0)
+                classList.push_back(std::make_pair(entries(kClass, j),
+                    entries(kCount, j)));
+            else
+                attrValues.insert(std::make_pair(entries(kAttr, j),
+                    entries(kValue, j)));
+        }
+        std::sort(classList.begin(), classList.end());
+
+        numClasses = static_cast<uint32_t>(classList.size());
+        this->resize();
+
+        attrValueCounts.setZero();
+        for (std::set<std::pair<double, double> >::const_iterator it
+                = attrValues.begin(); it != attrValues.end(); ++it)
+            attrValueCounts(static_cast<Index>(it->first) - 1) += 1;
+        for (Index k = 0; k < static_cast<Index>(classList.size()); ++k) {
+            classes(k) = classList[k].first;
+            classCounts(k) = classList[k].second;
+        }
+    }
+
+    /**
+     * @brief Compute log( P(C = c) * prod_i P(A_i = a_i | C = c) ) for all c
+     *
+     * As in the SQL implementation, attribute values not seen during training
+     * are ignored, and so are zero counts if there is no smoothing. Classes
+     * without any contributing attribute get -infinity.
+     *
+     * @return false if no class has a contributing attribute
+     */
+    bool logProbabilities(const MappedColumnVector& inX,
+        double inSmoothingFactor, ColumnVector& outLogProbs) const {
+
+        if (numClasses == 0)
+            throw std::invalid_argument("Naive Bayes model is empty or was "
+                "not created by nb_train().");
+        else if (inX.size() != static_cast<Index>(numAttrs))
+            throw std::invalid_argument("Number of attributes does not match "
+                "the model.");
+        else if (!(inSmoothingFactor >= 0))
+            throw std::domain_error("Smoothing factor must be non-negative.");
+
+        Index n = static_cast<Index>(numClasses);
+        ColumnVector counts(n);
+        std::vector<bool> hasTerm(n, false);
+        outLogProbs.setZero(n);
+        for (Index i = 0; i < inX.size(); ++i) {
+            double attr = static_cast<double>(i + 1);
+            for (Index k = 0; k < n; ++k)
+                counts(k) = count(classes(k), attr, inX(i));
+            if (counts.maxCoeff() == 0)
+                continue;
+
+            for (Index k = 0; k < n; ++k) {
+                if (inSmoothingFactor > 0 || counts(k) > 0) {
+                    outLogProbs(k) += std::log(
+                        (counts(k) + inSmoothingFactor)
+                        / (classCounts(k)
+                            + inSmoothingFactor * attrValueCounts(i)));
+                    hasTerm[k] = true;
+                }
+            }
+        }
+
+        bool hasAnyTerm = false;
+        for (Index k = 0; k < n; ++k) {
+            if (hasTerm[k]) {
+                outLogProbs(k) += std::log(classCounts(k) / numRows);
+                hasAnyTerm = true;
+            } else
+                outLogProbs(k) = -std::numeric_limits<double>::infinity();
+        }
+        return hasAnyTerm;
+    }
+
+    uint64_type numRows;
+    uint32_type numAttrs;
+    uint32_type numClasses;
+    uint32_type capacity;
+    uint32_type numEntries;
+    Matrix_type entries;
+    ColumnVector_type attrValueCounts;
+    ColumnVector_type classes;
+    ColumnVector_type classCounts;
+
+private:
+    static uint64_t hashKey(double inClass, double inAttr, double inValue) {
+        double key[3] = { inClass, inAttr, inValue };
+        uint64_t hash = 0;
+        for (int i = 0; i < 3; ++i) {
+            uint64_t bits;
+            std::memcpy(&bits, &key[i], sizeof(bits));
+            hash = (hash ^ bits) * 0x9E3779B97F4A7C15ULL;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief Return the slot of the given key, or the empty slot where it
+     *     would be inserted
+     */
+    Index find(double inClass, double inAttr, double inValue) const {
+        uint64_t mask = static_cast<uint64_t>(capacity) - 1;
+        for (uint64_t pos = hashKey(inClass, inAttr, inValue) & mask; ;
+            pos = (pos + 1) & mask) {
+
+            Index j = static_cast<Index>(pos);
+            if (entries(kCount, j) == 0
+                || (entries(kClass, j) == inClass
+                    && entries(kAttr, j) == inAttr
+                    && entries(kValue, j) == inValue))
+                return j;
+        }
+    }
+
+    double count(double inClass, double inAttr, double inValue) const {
+        // Adding 0 turns -0 into +0, so that both hash to the same slot
+        return entries(kCount, find(inClass, inAttr, inValue + 0.));
+    }
+
+    void add(double inClass, double inAttr, double inValue, double inCount) {
+        if (2 * (static_cast<uint64_t>(numEntries) + 1)
+            > static_cast<uint64_t>(capacity))
+            rehash(2 * static_cast<uint32_t>(capacity));
+
+        inValue += 0.;
+        Index j = find(inClass, inAttr, inValue);
+        if (entries(kCount, j) == 0) {
+            entries(kClass, j) = inClass;
+            entries(kAttr, j) = inAttr;
+            entries(kValue, j) = inValue;
+            numEntries++;
+        }
+        entries(kCount, j) += inCount;
+    }
+
+    void rehash(uint32_t inCapacity) {
+        Matrix oldEntries = entries;
+        capacity = inCapacity;
+        numEntries = 0;
+        this->resize();
+
+        entries.setZero();
+        for (Index j = 0; j < oldEntries.cols(); ++j) {
+            if (oldEntries(kCount, j) != 0) {
+                entries.col(find(oldEntries(kClass, j), oldEntries(kAttr, j),
+                    oldEntries(kValue, j))) = oldEntries.col(j);
+                numEntries++;
+            }
+        }
+    }
+};
+
+typedef NaiveBayesState<RootContainer> NaiveBayesModel;
+typedef NaiveBayesState<MutableRootContainer> MutableNaiveBayesState;
+
+/**
+ * @brief Perform the naive-Bayes training transition step
+ */
+AnyType
+nb_train_transition::run(AnyType& args) {
+    MutableNaiveBayesState state = args[0].getAs<MutableByteString>();
+    int32_t c = args[1].getAs<int32_t>();
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+
+    state << MutableNaiveBayesState::tuple_type(c, x);
+    return state.storage();
+}
+
+/**
+ * @brief Perform the merging of two transition states
+ */
+AnyType
+nb_train_merge::run(AnyType& args) {
+    MutableNaiveBayesState stateLeft = args[0].getAs<MutableByteString>();
+    NaiveBayesModel stateRight = args[1].getAs<ByteString>();
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+/**
+ * @brief Perform the naive-Bayes training final step
+ */
+AnyType
+nb_train_final::run(AnyType& args) {
+    MutableNaiveBayesState state = args[0].getAs<MutableByteString>();
+
+    if (state.numRows == 0)
+        return Null();
+
+    state.finalize();
+    return state.storage();
+}
+
+/**
+ * @brief Return the classes of a model in ascending order
+ *
+ * This is the order of the probabilities returned by nb_probs().
+ */
+AnyType
+nb_classes::run(AnyType& args) {
+    NaiveBayesModel model = args[0].getAs<ByteString>();
+
+    MutableArrayHandle<int32_t> result = allocateArray<int32_t,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+            model.numClasses);
+    for (uint32_t k = 0; k < model.numClasses; ++k)
+        result[k] = static_cast<int32_t>(model.classes(k));
+    return result;
+}
+
+/**
+ * @brief Return the most likely class(es) for an attribute array
+ */
+AnyType
+nb_classify::run(AnyType& args) {
+    NaiveBayesModel model = args[0].getAs<ByteString>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    double smoothingFactor = args[2].getAs<double>();
+
+    ColumnVector logProbs;
+    if (!model.logProbabilities(x, smoothingFactor, logProbs))
+        return Null();
+
+    double maxLogProb = logProbs.maxCoeff();
+    std::vector<int32_t> best;
+    for (Index k = 0; k < logProbs.size(); ++k)
+        if (logProbs(k) == maxLogProb)
+            best.push_back(static_cast<int32_t>(model.classes(k)));
+
+    MutableArrayHandle<int32_t> result = allocateArray<int32_t,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+            best.size());
+    std::copy(best.begin(), best.end(), result.ptr());
+    return result;
+}
+
+/**
+ * @brief Return the naive-Bayes probabilities of all classes
+ *
+ * Probabilities are normalized to sum to 1 and are in the order of
+ * nb_classes().
+ */
+AnyType
+nb_probs::run(AnyType& args) {
+    NaiveBayesModel model = args[0].getAs<ByteString>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    double smoothingFactor = args[2].getAs<double>();
+
+    ColumnVector logProbs;
+    if (!model.logProbabilities(x, smoothingFactor, logProbs))
+        return Null();
+
+    // Subtract the maximum before exponentiating, to avoid underflow
+    ColumnVector probs
+        = (logProbs.array() - logProbs.maxCoeff()).exp().matrix();
+    probs /= probs.sum();
+    return probs;
+}
+
+} // namespace bayes
+
+} // namespace modules
+
+} // namespace madlib
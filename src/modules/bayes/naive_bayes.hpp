@@ -0,0 +1,35 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Naive Bayes training: Transition function
+ */
+DECLARE_UDF(bayes, nb_train_transition)
+
+/**
+ * @brief Naive Bayes training: State merge function
+ */
+DECLARE_UDF(bayes, nb_train_merge)
+
+/**
+ * @brief Naive Bayes training: Final function
+ */
+DECLARE_UDF(bayes, nb_train_final)
+
+/**
+ * @brief Naive Bayes: Classes of a trained model
+ */
+DECLARE_UDF(bayes, nb_classes)
+
+/**
+ * @brief Naive Bayes: Most likely class(es) of an attribute array
+ */
+DECLARE_UDF(bayes, nb_classify)
+
+/**
+ * @brief Naive Bayes: Class probabilities of an attribute array
+ */
+DECLARE_UDF(bayes, nb_probs)
@@ -71,10 +71,13 @@ LMF<Model, Tuple>::gradientInPlace(
         const double                        &stepsize) {
     // Please refer to the design document for an explanation of the following
     double e = model.matrixU.row(x.i) * trans(model.matrixV.row(x.j)) - y;
-    RowVector temp = model.matrixU.row(x.i)
-        - stepsize * e * model.matrixV.row(x.j);
-    model.matrixV.row(x.j) -= stepsize * e * model.matrixU.row(x.i);
-    model.matrixU.row(x.i) = temp;
+    // Update both rows element by element, so that no temporary row vector
+    // has to be allocated for every tuple
+    for (Index k = 0; k < model.matrixU.cols(); k++) {
+        double u = model.matrixU(x.i, k);
+        model.matrixU(x.i, k) -= stepsize * e * model.matrixV(x.j, k);
+        model.matrixV(x.j, k) -= stepsize * e * u;
+    }
 }
 
 template <class Model, class Tuple>
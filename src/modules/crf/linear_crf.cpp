@@ -7,6 +7,7 @@
  * We implement limited-memory BFGS method.
  *
  *//* ----------------------------------------------------------------------- */
+#include <algorithm>
 #include <iostream>
 #include <dbconnector/dbconnector.hpp>
 #include <modules/shared/HandleTraits.hpp>
@@ -664,37 +665,115 @@ void LBFGS::lbfgs(int n, int m, double f, Eigen::VectorXd g, double eps,
 }
 
 /**
- *@brief compute exponential of Mi and Vi
+ * @brief Work space of the transition function
+ *
+ * The edge potentials do not depend on the position, and during one
+ * iteration (i.e., one query) the coefficients do not change either. We
+ * therefore keep the transition matrix and its exponential, together with the
+ * buffers for forward-backward, in the per-query cache (see
+ * AnyType::getUserFuncContext()). The matrix is built once per gradient pass
+ * and rebuilt only if a sequence comes with different edge features than the
+ * cached ones; the state features are added per position in
+ * compute_logli_gradient().
+ *
+ * Like SystemInformation, this must be a plain-old data type, because it lives
+ * in a PostgreSQL memory context and is never destructed.
  */
-void compute_exp_Mi(int num_labels, Eigen::MatrixXd &Mi, Eigen::VectorXd &Vi) {
-    // take exponential operator
-    for (int m = 0; m < num_labels; m++) {
-        Vi(m) = std::exp(Vi(m));
-        for (int n = 0; n < num_labels; n++) {
-            Mi(m, n) = std::exp(Mi(m, n));
-        }
+struct LinCrfWorkspace {
+    MemoryContext context;
+    uint32_t num_labels;
+    uint32_t num_features;
+    uint32_t seq_capacity;
+    uint32_t edge_size;
+    uint32_t edge_capacity;
+    bool valid;
+    double *edges;   // edge_size: the sparse_m that Mi was built from
+    double *Mi;      // num_labels x num_labels: sum of edge-feature weights
+    double *expMi;   // num_labels x num_labels: exp(Mi)
+    double *vectors; // 4 x num_labels: Vi, alpha, next_alpha, temp
+    double *ExpF;    // num_features
+    double *betas;   // num_labels x seq_capacity
+    double *scale;   // seq_capacity
+};
+
+/**
+ * @brief Return the work space for the current query, (re)allocating it if
+ *     necessary
+ */
+LinCrfWorkspace &getWorkspace(AnyType &args, uint32_t num_labels,
+                              uint32_t num_features, uint32_t seq_len) {
+    MemoryContext context = args.getCacheMemoryContext();
+    LinCrfWorkspace *ws
+        = static_cast<LinCrfWorkspace *>(args.getUserFuncContext());
+
+    if (ws == NULL || ws->num_labels != num_labels
+        || ws->num_features != num_features) {
+        size_t L = num_labels;
+        ws = static_cast<LinCrfWorkspace *>(
+            MemoryContextAllocZero(context, sizeof(LinCrfWorkspace)));
+        ws->context = context;
+        ws->num_labels = num_labels;
+        ws->num_features = num_features;
+        ws->valid = false;
+        ws->Mi = static_cast<double *>(
+            MemoryContextAllocZero(context, L * L * sizeof(double)));
+        ws->expMi = static_cast<double *>(
+            MemoryContextAllocZero(context, L * L * sizeof(double)));
+        ws->vectors = static_cast<double *>(
+            MemoryContextAllocZero(context, 4 * L * sizeof(double)));
+        ws->ExpF = static_cast<double *>(
+            MemoryContextAllocZero(context, num_features * sizeof(double)));
+        args.setUserFuncContext(ws);
+    }
+
+    if (ws->seq_capacity < seq_len) {
+        uint32_t capacity = std::max(seq_len, 2 * ws->seq_capacity);
+        ws->betas = static_cast<double *>(MemoryContextAlloc(context,
+            static_cast<size_t>(num_labels) * capacity * sizeof(double)));
+        ws->scale = static_cast<double *>(
+            MemoryContextAlloc(context, capacity * sizeof(double)));
+        ws->seq_capacity = capacity;
     }
+    return *ws;
 }
 
-Eigen::VectorXd mult(Eigen::MatrixXd Mi, Eigen::VectorXd Vi, bool trans,
-                     int num_label)
-{
-    int i=0,j=0,r=0,c=0;
-    Eigen::VectorXd z(num_label);
-    z.fill(0);
-    for (i = 0; i < num_label; i++ )
-    {
-        for (j=0; j< num_label; j++) {
-            r= i;
-            c=j;
-            if(trans) {
-                r= j;
-                c=i;
-            }
-            z(r)+=Mi(i,j)*Vi(c);
-        }
+/**
+ * @brief Return exp(Mi), where Mi is the (position-invariant) matrix of edge
+ *     potentials
+ *
+ * Mi is kept in the work space, and only rebuilt if the edge features differ
+ * from those of the previous sequence.
+ */
+template <class CoefVector>
+const Eigen::Map<Eigen::MatrixXd>
+compute_exp_Mi(LinCrfWorkspace &ws, const CoefVector &coef,
+               const MappedColumnVector &sparse_m) {
+    Index L = ws.num_labels;
+    Eigen::Map<Eigen::MatrixXd> Mi(ws.Mi, L, L);
+    Eigen::Map<Eigen::MatrixXd> expMi(ws.expMi, L, L);
+    uint32_t sparse_m_size = static_cast<uint32_t>(sparse_m.size());
+
+    if (ws.valid && ws.edge_size == sparse_m_size
+        && std::equal(sparse_m.data(), sparse_m.data() + sparse_m_size,
+                      ws.edges))
+        return expMi;
+
+    if (ws.edge_capacity < sparse_m_size) {
+        uint32_t capacity = std::max(sparse_m_size, 2 * ws.edge_capacity);
+        ws.edges = static_cast<double *>(
+            MemoryContextAlloc(ws.context, capacity * sizeof(double)));
+        ws.edge_capacity = capacity;
     }
-    return z;
+    std::copy(sparse_m.data(), sparse_m.data() + sparse_m_size, ws.edges);
+    ws.edge_size = sparse_m_size;
+
+    //(f_index, prev_label, curr_label)
+    Mi.fill(0);
+    for (uint32_t n = 0; n + 2 < sparse_m_size; n += 3)
+        Mi((int)sparse_m(n+1), (int)sparse_m(n+2)) += coef((int)sparse_m(n));
+    expMi = Mi.array().exp().matrix();
+    ws.valid = true;
+    return expMi;
 }
 
 
@@ -702,22 +781,25 @@ Eigen::VectorXd mult(Eigen::MatrixXd Mi, Eigen::VectorXd Vi, bool trans,
  *@brief compute loglikelihood and gradient using forward-backward algorithm
  */
 void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double> >& state,
+                            LinCrfWorkspace& ws,
                             MappedColumnVector& sparse_r,
                             MappedColumnVector& dense_m,
                             MappedColumnVector& sparse_m) {
     int r_size = static_cast<int>(sparse_r.size());
     int sparse_m_size = static_cast<int>(sparse_m.size());
     int seq_len = static_cast<int>(sparse_r(r_size-2)) + 1;
-
-    Eigen::MatrixXd betas(static_cast<uint32_t>(state.num_labels), seq_len);
-    Eigen::VectorXd scale(seq_len);
-    Eigen::MatrixXd Mi(static_cast<uint32_t>(state.num_labels),
-                                    static_cast<uint32_t>(state.num_labels));
-    Eigen::VectorXd Vi(state.num_labels);
-    Eigen::VectorXd alpha(state.num_labels);
-    Eigen::VectorXd next_alpha(state.num_labels);
-    Eigen::VectorXd temp(state.num_labels);
-    Eigen::VectorXd ExpF(state.num_features);
+    Index L = state.num_labels;
+
+    const Eigen::Map<Eigen::MatrixXd> Mi
+        = compute_exp_Mi(ws, state.coef, sparse_m);
+
+    Eigen::Map<Eigen::MatrixXd> betas(ws.betas, L, seq_len);
+    Eigen::Map<Eigen::VectorXd> scale(ws.scale, seq_len);
+    Eigen::Map<Eigen::VectorXd> Vi(ws.vectors, L);
+    Eigen::Map<Eigen::VectorXd> alpha(ws.vectors + L, L);
+    Eigen::Map<Eigen::VectorXd> next_alpha(ws.vectors + 2 * L, L);
+    Eigen::Map<Eigen::VectorXd> temp(ws.vectors + 3 * L, L);
+    Eigen::Map<Eigen::VectorXd> ExpF(ws.ExpF, state.num_features);
     betas.fill(0);
     scale.fill(0);
     alpha.fill(1);
@@ -731,7 +813,6 @@ void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double
 
     int index = r_size-1;
     for (int i = seq_len - 1; i > 0; i--) {
-        Mi.fill(0);
         Vi.fill(0);
         // examine all features at position "pos"
         //(prev_labe, curr_label, f_index, start_pos, exist)
@@ -741,16 +822,10 @@ void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double
             Vi(curr_index) += state.coef(f_index);
             index-=5;
         }
-        //(f_index, prev_label, curr_label)
-        for(int n=0; n+2<sparse_m_size ; n+=3) {
-            Mi((int)sparse_m(n+1), (int)sparse_m(n+2)) += state.coef((int)sparse_m(n));
-        }
+        Vi = Vi.array().exp().matrix();
 
-        compute_exp_Mi(state.num_labels, Mi, Vi);
-
-        temp=betas.col(i);
-        temp=temp.cwiseProduct(Vi);
-        betas.col(i -1) = mult(Mi,temp,false,state.num_labels);
+        temp = betas.col(i).cwiseProduct(Vi);
+        betas.col(i - 1).noalias() = Mi * temp;
         // scale for the next (backward) beta values
         scale(i - 1)=betas.col(i-1).sum();
         betas.col(i - 1)*=(1.0 / scale(i - 1));
@@ -759,7 +834,6 @@ void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double
     index = 0;
     // start to compute the log-likelihood of the current sequence
     for (int j = 0; j < seq_len; j++) {
-        Mi.fill(0);
         Vi.fill(0);
         // examine all features at position "pos"
         int ori_index = index;
@@ -769,17 +843,11 @@ void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double
             Vi(curr_index) += state.coef(f_index);
             index+=5;
         }
-        if(j>=1)
-            for(int n=0; n+2<sparse_m_size ; n+=3) {
-                Mi((int)sparse_m(n+1), (int)sparse_m(n+2)) += state.coef((int)sparse_m(n));
-            }
-
-        compute_exp_Mi(state.num_labels, Mi, Vi);
+        Vi = Vi.array().exp().matrix();
 
         if(j>0) {
-            temp = alpha;
-            next_alpha=mult(Mi,temp,true,state.num_labels);
-            next_alpha=next_alpha.cwiseProduct(Vi);
+            next_alpha.noalias() = Mi.transpose() * alpha;
+            next_alpha = next_alpha.cwiseProduct(Vi);
         } else {
             next_alpha=Vi;
         }
@@ -825,10 +893,7 @@ void compute_logli_gradient(LinCrfLBFGSTransitionState<MutableArrayHandle<double
         state.loglikelihood -= std::log(scale(k));
     }
     // update the gradient vector
-    for (size_t k = 0; k < state.num_features; k++) {
-        state.grad(k) -= ExpF(k) / Zx;
-    }
-
+    state.grad -= ExpF / Zx;
 }
 
 /**
@@ -849,7 +914,10 @@ lincrf_lbfgs_step_transition::run(AnyType &args) {
         }
     }
     state.numRows++;
-    compute_logli_gradient(state, sparse_r, dense_m, sparse_m);
+    LinCrfWorkspace &ws = getWorkspace(args, state.num_labels,
+        state.num_features,
+        static_cast<uint32_t>(sparse_r(sparse_r.size() - 2)) + 1);
+    compute_logli_gradient(state, ws, sparse_r, dense_m, sparse_m);
     return state;
 }
 
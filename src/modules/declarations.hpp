@@ -20,3 +20,4 @@
 #include "linalg/matrix_op.hpp"
 #include "linalg/svd.hpp"
 #include "centrality/centrality.hpp"
+#include "bayes/bayes.hpp"
@@ -8,6 +8,7 @@
 
 #include "elastic_net_gaussian_igd.hpp"
 #include "elastic_net_gaussian_fista.hpp"
+#include "elastic_net_gaussian_cd.hpp"
 #include "elastic_net_binomial_igd.hpp"
 #include "elastic_net_binomial_fista.hpp"
 #include "elastic_net_utils.hpp"
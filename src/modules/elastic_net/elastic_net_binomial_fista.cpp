@@ -99,7 +99,7 @@ inline void BinomialFista::active_transition (FistaState<MutableArrayHandle<doub
 {
     if (state.backtracking == 0) // Compute gradient for active set
     {
-        double r = state.intercept_y + sparse_dot(state.coef_y, x);
+        double r = state.intercept_y + state.active_dot(state.coef_y, x);
         double u;
         
         if (y > 0)
@@ -107,9 +107,11 @@ inline void BinomialFista::active_transition (FistaState<MutableArrayHandle<doub
         else
             u = 1. / (1. + std::exp(-r));
         
-        for (uint32_t i = 0; i < state.dimension; i++)
-            if (state.coef_y(i) != 0)
-                state.gradient(i) += x(i) * u;
+        for (uint32_t k = 0; k < state.num_active; k++)
+        {
+            uint32_t i = static_cast<uint32_t>(state.active_index(k));
+            state.gradient(i) += x(i) * u;
+        }
 
         // always update intercept
         state.gradient_intercept += u;
@@ -124,7 +126,7 @@ inline void BinomialFista::backtracking_transition (FistaState<MutableArrayHandl
                                                     MappedColumnVector& x, double y)
 {
     // during backtracking, always use b_coef and b_intercept
-    double r = state.b_intercept + sparse_dot(state.b_coef, x);
+    double r = state.b_intercept + state.active_dot(state.b_coef, x);
 
     if (y > 0)
         state.fn += std::log(1 + std::exp(-r));
@@ -134,7 +136,7 @@ inline void BinomialFista::backtracking_transition (FistaState<MutableArrayHandl
     // Qfn only need to be calculated once in each backtracking
     if (state.backtracking == 1)
     {
-        r = state.intercept_y + sparse_dot(state.coef_y, x);
+        r = state.intercept_y + state.active_dot(state.coef_y, x);
         if (y > 0)
             state.Qfn += std::log(1 + std::exp(-r));
         else
@@ -0,0 +1,369 @@
+
+#include "dbconnector/dbconnector.hpp"
+#include "elastic_net_gaussian_cd.hpp"
+#include "modules/regress/LinearRegression_proto.hpp"
+#include "modules/regress/LinearRegression_impl.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace madlib {
+namespace modules {
+namespace elastic_net {
+
+using namespace madlib::dbal::eigen_integration;
+
+typedef regress::LinearRegressionAccumulator<RootContainer> GramState;
+
+/*
+  Coordinate descent with covariance updates (Friedman, Hastie and Tibshirani,
+  2010) for the Gaussian elastic net.
+
+  With the intercept profiled out, the objective only depends on the data
+  through the centered Gram matrix C = X'X/n - mean(x) mean(x)' and the
+  vector c = X'y/n - mean(x) mean(y):
+
+      1/2 b'Cb - c'b + lambda * (alpha * |b|_1 + (1 - alpha)/2 * |b|^2)
+
+  Hence a single pass over the data suffices, after which the whole lambda
+  path is solved in memory. The gradient g = c - Cb is kept up to date, so
+  that updating one coefficient costs O(p). Sequential strong rules discard
+  features that are likely to stay zero, and the KKT conditions are checked
+  on the discarded features after convergence.
+ */
+class GaussianCd
+{
+  public:
+    GaussianCd (const Matrix& gram, const ColumnVector& xy, double in_alpha,
+                int in_max_iter, double in_tolerance);
+
+    double lambda_max () const;
+    void solve (double lambda, double prev_lambda);
+
+    ColumnVector coef;
+    int iterations;
+
+  private:
+    double sweep (const std::vector<int>& set, double lambda);
+
+    const Matrix& C;
+    const ColumnVector& c;
+    double alpha;
+    int max_iter;
+    double tolerance;
+    ColumnVector gradient;
+    std::vector<bool> in_strong_set;
+};
+
+// ------------------------------------------------------------------------
+
+inline GaussianCd::GaussianCd (const Matrix& gram, const ColumnVector& xy,
+                               double in_alpha, int in_max_iter,
+                               double in_tolerance)
+  : coef(ColumnVector::Zero(xy.size())), iterations(0), C(gram), c(xy),
+    alpha(in_alpha), max_iter(in_max_iter), tolerance(in_tolerance),
+    gradient(xy), in_strong_set(xy.size(), false)
+{ }
+
+// ------------------------------------------------------------------------
+// the smallest lambda for which all coefficients are zero
+inline double GaussianCd::lambda_max () const
+{
+    // for ridge regression, use the same small alpha as glmnet
+    return c.cwiseAbs().maxCoeff() / std::max(alpha, 1e-3);
+}
+
+// ------------------------------------------------------------------------
+// one pass over the given features, returns the largest weighted change
+inline double GaussianCd::sweep (const std::vector<int>& set, double lambda)
+{
+    double threshold = lambda * alpha;
+    double ridge = lambda * (1 - alpha);
+    double max_change = 0;
+
+    for (size_t k = 0; k < set.size(); k++)
+    {
+        int j = set[k];
+        double cjj = C(j, j);
+        if (cjj <= 0) continue; // constant feature
+
+        double z = gradient(j) + cjj * coef(j);
+        double updated = 0;
+        if (z > threshold)
+            updated = (z - threshold) / (cjj + ridge);
+        else if (z < - threshold)
+            updated = (z + threshold) / (cjj + ridge);
+
+        double delta = updated - coef(j);
+        if (delta != 0)
+        {
+            gradient -= delta * C.col(j);
+            coef(j) = updated;
+            max_change = std::max(max_change, cjj * delta * delta);
+        }
+    }
+
+    iterations++;
+    return max_change;
+}
+
+// ------------------------------------------------------------------------
+/*
+  Solve for one lambda, using the current coefficients as warm start.
+  prev_lambda is the previous value on the path (lambda_max for the first
+  one) and is used by the strong rule.
+ */
+inline void GaussianCd::solve (double lambda, double prev_lambda)
+{
+    int p = static_cast<int>(coef.size());
+    double screen = alpha * (2 * lambda - prev_lambda);
+
+    std::vector<int> strong_set;
+    for (int j = 0; j < p; j++)
+    {
+        in_strong_set[j] = coef(j) != 0 || std::fabs(gradient(j)) >= screen;
+        if (in_strong_set[j]) strong_set.push_back(j);
+    }
+
+    int iter = 0;
+    while (true)
+    {
+        // iterate on the active set until convergence, then make one pass
+        // over the whole strong set to see whether the active set changed
+        while (iter < max_iter)
+        {
+            iter++;
+            if (sweep(strong_set, lambda) < tolerance) break;
+
+            std::vector<int> active_set;
+            for (size_t k = 0; k < strong_set.size(); k++)
+                if (coef(strong_set[k]) != 0)
+                    active_set.push_back(strong_set[k]);
+            while (iter < max_iter)
+            {
+                iter++;
+                if (sweep(active_set, lambda) < tolerance) break;
+            }
+        }
+
+        // KKT check on the features discarded by the strong rule
+        bool violated = false;
+        for (int j = 0; j < p; j++)
+            if (!in_strong_set[j] && C(j, j) > 0
+                    && std::fabs(gradient(j)) > lambda * alpha)
+            {
+                in_strong_set[j] = true;
+                strong_set.push_back(j);
+                violated = true;
+            }
+        if (!violated || iter >= max_iter) break;
+    }
+}
+
+// ------------------------------------------------------------------------
+
+/*
+  The centered (and, if standardize is true, scaled) Gram matrix of a
+  linear regression state that was computed with independent variables
+  array[1] || x, so that the first row/column of X'X holds the row count and
+  the column sums of x.
+ */
+struct GaussianGram
+{
+    GaussianGram (const GramState& state, bool standardize);
+
+    // coefficients and intercept on the original scale of the data
+    ColumnVector unscale (const ColumnVector& b) const
+    { return b.cwiseQuotient(scale); }
+    double intercept (const ColumnVector& coef) const
+    { return ymean - dot(coef, xmean); }
+
+    int p;
+    ColumnVector xmean;
+    double ymean;
+    Matrix gram;
+    ColumnVector xy;
+    double yy;
+    ColumnVector scale;
+};
+
+// ------------------------------------------------------------------------
+
+inline GaussianGram::GaussianGram (const GramState& state, bool standardize)
+{
+    if (static_cast<uint64_t>(state.numRows) == 0)
+        throw std::invalid_argument("Elastic Net error: No data to fit!");
+
+    double n = static_cast<double>(static_cast<uint64_t>(state.numRows));
+    p = static_cast<uint16_t>(state.widthOfX) - 1;
+
+    // the accumulator only maintains the lower triangle of X'X
+    Matrix full = state.X_transp_X.selfadjointView<Eigen::Lower>();
+    xmean = full.col(0).tail(p) / n;
+    ymean = state.X_transp_Y(0) / n;
+    gram = full.bottomRightCorner(p, p) / n - xmean * trans(xmean);
+    xy = state.X_transp_Y.tail(p) / n - xmean * ymean;
+    yy = static_cast<double>(state.y_square_sum) / n - ymean * ymean;
+
+    // guard against round-off for constant features
+    for (int j = 0; j < p; j++)
+        if (gram(j, j) <= 1e-14 * full(j + 1, j + 1) / n)
+            gram(j, j) = 0;
+
+    scale = ColumnVector::Ones(p);
+    if (standardize)
+        for (int j = 0; j < p; j++)
+            if (gram(j, j) > 0) scale(j) = std::sqrt(gram(j, j));
+    gram = scale.cwiseInverse().asDiagonal() * gram
+        * scale.cwiseInverse().asDiagonal();
+    xy = xy.cwiseQuotient(scale);
+}
+
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+// ------------------------------------------------------------------------
+
+/*
+  The following are the functions that are actually called by SQL
+*/
+
+/**
+   @brief Solve the elastic net on the lambda path that ends at the given
+   lambda value
+
+   The input is the state of linregr() computed with independent variables
+   array[1] || x, so that the first row/column of X'X holds the row count and
+   the column sums of x.
+
+   Returns the coefficients and intercept on the original scale of the data,
+   the log-likelihood as defined by the other optimizers (on the standardized
+   scale, if standardize is true), and the total number of coordinate
+   descent sweeps.
+*/
+AnyType __gaussian_cd_solve::run (AnyType& args)
+{
+    GramState state = args[0].getAs<ByteString>();
+    double lambda = args[1].getAs<double>();
+    double alpha = args[2].getAs<double>();
+    bool standardize = args[3].getAs<bool>();
+    int lambda_no = args[4].getAs<int>();
+    int max_iter = args[6].getAs<int>();
+    double tolerance = args[7].getAs<double>();
+
+    if (lambda_no < 1)
+        throw std::invalid_argument("Elastic Net error: Number of lambdas "
+            "on the path must be a positive integer!");
+
+    GaussianGram data(state, standardize);
+    GaussianCd cd(data.gram, data.xy, alpha, max_iter, tolerance);
+
+    std::vector<double> lambdas;
+    if (!args[5].isNull())
+    {
+        MappedColumnVector given = args[5].getAs<MappedColumnVector>();
+        for (int i = 0; i < given.size(); i++)
+            lambdas.push_back(given(i));
+    }
+    else
+    {
+        double largest = cd.lambda_max();
+        if (lambda_no == 1 || lambda >= largest)
+            lambdas.push_back(lambda);
+        else
+        {
+            double smallest = lambda > 0 ? lambda : 1e-3 * largest;
+            double step = std::log(largest / smallest) / (lambda_no - 1);
+            for (int i = 0; i < lambda_no; i++)
+                lambdas.push_back(largest * std::exp(- i * step));
+            lambdas.back() = smallest;
+            if (lambda == 0) lambdas.push_back(0);
+        }
+    }
+
+    double prev_lambda = cd.lambda_max();
+    for (size_t i = 0; i < lambdas.size(); i++)
+    {
+        cd.solve(lambdas[i], prev_lambda);
+        prev_lambda = lambdas[i];
+    }
+
+    const ColumnVector& b = cd.coef;
+    double loss = (data.yy - 2 * dot(b, data.xy) + dot(b, data.gram * b)) / 2;
+    double log_likelihood = - (loss + lambda * ((1 - alpha) * dot(b, b) / 2
+        + alpha * b.lpNorm<1>()));
+
+    ColumnVector coef = data.unscale(b);
+    double intercept = data.intercept(coef);
+
+    AnyType tuple;
+    tuple << intercept << coef << log_likelihood << cd.iterations;
+    return tuple;
+}
+
+// ------------------------------------------------------------------------
+
+/**
+   @brief Validation error along a lambda path for one cross-validation fold
+
+   train_state and valid_state are linregr() states (with independent
+   variables array[1] || x) of the training and the validation part of the
+   data. For each lambda value, the model is fitted on the training part, and
+   the mean squared error on the validation part is computed from the
+   sufficient statistics of valid_state, i.e., without touching the data
+   again.
+*/
+AnyType __gaussian_cd_cv_error::run (AnyType& args)
+{
+    GramState train_state = args[0].getAs<ByteString>();
+    GramState valid_state = args[1].getAs<ByteString>();
+    double alpha = args[2].getAs<double>();
+    bool standardize = args[3].getAs<bool>();
+    MappedColumnVector lambdas = args[4].getAs<MappedColumnVector>();
+    int max_iter = args[5].getAs<int>();
+    double tolerance = args[6].getAs<double>();
+
+    if (static_cast<uint64_t>(valid_state.numRows) == 0)
+        throw std::invalid_argument("Elastic Net error: No data to validate!");
+    if (static_cast<uint16_t>(valid_state.widthOfX)
+            != static_cast<uint16_t>(train_state.widthOfX))
+        throw std::invalid_argument("Elastic Net error: Training and "
+            "validation data have different numbers of features!");
+
+    GaussianGram data(train_state, standardize);
+    GaussianCd cd(data.gram, data.xy, alpha, max_iter, tolerance);
+    double n_valid = static_cast<double>(
+        static_cast<uint64_t>(valid_state.numRows));
+
+    // warm starts and strong rules need decreasing lambda values
+    std::vector<std::pair<double, int> > order;
+    for (int i = 0; i < lambdas.size(); i++)
+        order.push_back(std::make_pair(- lambdas(i), i));
+    std::sort(order.begin(), order.end());
+
+    ColumnVector error(lambdas.size());
+    ColumnVector b(data.p + 1);
+    double prev_lambda = cd.lambda_max();
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        double lambda = - order[k].first;
+        cd.solve(lambda, std::max(lambda, prev_lambda));
+        prev_lambda = lambda;
+
+        // b = [intercept; coef], so that the validation residual sum of
+        // squares is y'y - 2 b'X'y + b'X'Xb
+        b.tail(data.p) = data.unscale(cd.coef);
+        b(0) = data.intercept(b.tail(data.p));
+        double rss = static_cast<double>(valid_state.y_square_sum)
+            - 2 * dot(b, valid_state.X_transp_Y)
+            + dot(b, valid_state.X_transp_X
+                .selfadjointView<Eigen::Lower>() * b);
+        error(order[k].second) = std::max(rss, 0.) / n_valid;
+    }
+
+    return error;
+}
+
+}
+}
+}
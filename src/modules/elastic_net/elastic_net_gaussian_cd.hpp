@@ -0,0 +1,16 @@
+/**
+ * Elastic net regulation for linear regression using coordinate descent
+ * on the Gram matrix
+ */
+
+/**
+ * @brief Linear regression (coordinate descent): Solve the regularization
+ *     path from the accumulated Gram matrix
+ */
+DECLARE_UDF(elastic_net, __gaussian_cd_solve)
+
+/**
+ * @brief Linear regression (coordinate descent): Validation error of one
+ *     cross-validation fold along a lambda path
+ */
+DECLARE_UDF(elastic_net, __gaussian_cd_cv_error)
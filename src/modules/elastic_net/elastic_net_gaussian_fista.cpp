@@ -94,13 +94,13 @@ inline void GaussianFista::backtracking_transition (FistaState<MutableArrayHandl
                                                     MappedColumnVector& x, double y)
 {
     // during backtracking, always use b_coef and b_intercept
-    double r = y - state.b_intercept - sparse_dot(state.b_coef, x);
+    double r = y - state.b_intercept - state.active_dot(state.b_coef, x);
     state.fn += r * r * 0.5;
     
     // Qfn only need to be calculated once in each backtracking
     if (state.backtracking == 1)
     {
-        r = y - state.intercept_y - sparse_dot(state.coef_y, x);
+        r = y - state.intercept_y - state.active_dot(state.coef_y, x);
         state.Qfn += r * r * 0.5;
     }
 }
@@ -134,10 +134,12 @@ inline void GaussianFista::active_transition (FistaState<MutableArrayHandle<doub
                                               MappedColumnVector& x, double y)
 {
     if (state.backtracking == 0) {
-        double r = y - state.intercept_y - sparse_dot(state.coef_y, x);
-        for (uint32_t i = 0; i < state.dimension; i++)
-            if (state.coef_y(i) != 0)
-                state.gradient(i) += - x(i) * r;
+        double r = y - state.intercept_y - state.active_dot(state.coef_y, x);
+        for (uint32_t k = 0; k < state.num_active; k++)
+        {
+            uint32_t i = static_cast<uint32_t>(state.active_index(k));
+            state.gradient(i) += - x(i) * r;
+        }
 
         state.gradient_intercept += - r;
     } else 
@@ -7,9 +7,11 @@
 #include "state/fista.hpp"
 #include "share/shared_utils.hpp"
 
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <vector>
 
 namespace madlib {
 namespace modules {
@@ -28,6 +30,10 @@ class Fista
   private:
     static void proxy (CVector& y, CVector& gradient_y, CVector& x,
                        double stepsize, double lambda);
+    static void strong_rule_screen (FistaState<MutableArrayHandle<double> >& state,
+                                    double lambda, const Allocator& inAllocator);
+    static void update_active_set (FistaState<MutableArrayHandle<double> >& state,
+                                   const Allocator& inAllocator);
 };
 
 // ------------------------------------------------------------------------
@@ -53,6 +59,57 @@ inline void Fista<Model>::proxy (CVector& y, CVector& gradient_y, CVector& x,
 
 // ------------------------------------------------------------------------
 
+/*
+  Sequential strong rule (Tibshirani et al., 2012): when lambda decreases
+  from state.lambda to lambda, a feature whose gradient at the previous
+  solution is small is likely to stay zero. Only the remaining features
+  (and the ones that are already non-zero) go into the active set.
+
+  The rule is only a heuristic. The driver always finishes a lambda with a
+  non-active iteration, which computes the full gradient and so checks the
+  KKT conditions for the discarded features.
+ */
+template <class Model>
+inline void Fista<Model>::strong_rule_screen (
+    FistaState<MutableArrayHandle<double> >& state, double lambda,
+    const Allocator& inAllocator)
+{
+    double screen = state.alpha * (2 * lambda - state.lambda);
+    std::vector<uint32_t> active;
+    for (uint32_t i = 0; i < state.dimension; i++)
+        if (state.coef(i) != 0 || std::abs(state.gradient(i)) >= screen)
+            active.push_back(i);
+    state.set_active_set(inAllocator, active);
+}
+
+// ------------------------------------------------------------------------
+
+/*
+  Add the features that became non-zero in the last non-active iteration,
+  so that the active set always covers the support of coef_y
+ */
+template <class Model>
+inline void Fista<Model>::update_active_set (
+    FistaState<MutableArrayHandle<double> >& state,
+    const Allocator& inAllocator)
+{
+    std::vector<bool> in_set(state.dimension, false);
+    std::vector<uint32_t> active;
+    for (uint32_t k = 0; k < state.num_active; k++)
+    {
+        uint32_t i = static_cast<uint32_t>(state.active_index(k));
+        in_set[i] = true;
+        active.push_back(i);
+    }
+    for (uint32_t i = 0; i < state.dimension; i++)
+        if (state.coef_y(i) != 0 && !in_set[i])
+            active.push_back(i);
+    if (active.size() != state.num_active)
+        state.set_active_set(inAllocator, active);
+}
+
+// ------------------------------------------------------------------------
+
 /**
    @brief Perform FISTA transition step
 
@@ -70,7 +127,8 @@ AnyType Fista<Model>::fista_transition (AnyType& args, const Allocator& inAlloca
         if (!args[3].isNull())
         {
             FistaState<ArrayHandle<double> > pre_state = args[3];
-            state.allocate(inAllocator, pre_state.dimension);
+            state.allocate(inAllocator, pre_state.dimension,
+                           pre_state.num_active);
             state = pre_state;
         }
         else
@@ -106,21 +164,14 @@ AnyType Fista<Model>::fista_transition (AnyType& args, const Allocator& inAlloca
             state.random_stepsize = args[12].getAs<int>();
         }
 
-        if (state.backtracking == 0)
-        {
-            state.gradient.setZero();
-            state.gradient_intercept = 0;
-        }
-        else
-        {
-            state.fn = 0;
-            if (state.backtracking == 1) state.Qfn = 0;
-        }
-
         // lambda is changing if warm-up is used
         // so needs to update it everytime
         if (state.lambda != lambda)
         {
+            // the gradient still belongs to the previous lambda
+            if (state.use_active_set == 1)
+                strong_rule_screen(state, lambda, inAllocator);
+
             // restore initial conditions
             state.lambda = lambda;
             state.tk = 1;
@@ -132,9 +183,23 @@ AnyType Fista<Model>::fista_transition (AnyType& args, const Allocator& inAlloca
             state.intercept_y = state.intercept;
         }
 
+        if (state.backtracking == 0)
+        {
+            state.gradient.setZero();
+            state.gradient_intercept = 0;
+        }
+        else
+        {
+            state.fn = 0;
+            if (state.backtracking == 1) state.Qfn = 0;
+        }
+
         state.numRows = 0; // resetting
 
         state.is_active = args[11].getAs<int>();
+        if (state.use_active_set == 1 && state.is_active == 1
+                && state.backtracking == 0)
+            update_active_set(state, inAllocator);
     }
 
     MappedColumnVector x = args[1].getAs<MappedColumnVector>();
@@ -171,9 +236,11 @@ AnyType Fista<Model>::fista_merge (AnyType& args)
     if (state1.backtracking == 0) {
         if (state1.use_active_set == 1 && state1.is_active == 1)
         {
-            for (uint32_t i = 0; i < state1.dimension; i++)
-                if (state1.coef_y(i) != 0)
-                    state1.gradient(i) += state2.gradient(i);
+            for (uint32_t k = 0; k < state1.num_active; k++)
+            {
+                uint32_t i = static_cast<uint32_t>(state1.active_index(k));
+                state1.gradient(i) += state2.gradient(i);
+            }
         }
         else
             state1.gradient += state2.gradient;
@@ -11,6 +11,7 @@
 
 #include "dbconnector/dbconnector.hpp"
 #include "modules/shared/HandleTraits.hpp"
+#include <vector>
 // #include "convex/type/model.hpp"
 
 namespace madlib {
@@ -46,18 +47,40 @@ class FistaState
        @brief Allocating the needed memory blocks
     */
     inline void allocate (const Allocator& inAllocator,
-                          uint32_t inDimension)
+                          uint32_t inDimension, uint32_t inNumActive = 0)
     {
         mStorage = inAllocator.allocateArray<double,
                                              dbal::AggregateContext,
                                              dbal::DoZero,
                                              dbal::ThrowBadAlloc>(
-                                                 arraySize(inDimension));
-        dimension.rebind(&mStorage[0]);
-        dimension = inDimension;
+                                                 arraySize(inDimension, inNumActive));
+        mStorage[0] = inDimension;
+        mStorage[20 + 4 * inDimension] = inNumActive;
         rebind();
     }
 
+    /**
+       @brief Replace the active set
+
+       The state only has room for the indices of the active set, so it
+       is reallocated with the new size. All other elements are kept.
+    */
+    inline void set_active_set (const Allocator& inAllocator,
+                                const std::vector<uint32_t>& inActive)
+    {
+        Handle oldStorage = mStorage;
+        uint32_t oldDimension = dimension;
+        uint32_t oldBacktracking = backtracking;
+
+        allocate(inAllocator, oldDimension,
+                 static_cast<uint32_t>(inActive.size()));
+        for (uint32_t i = 1; i < 20 + 4 * oldDimension; i++)
+            mStorage[i] = oldStorage[i];
+        for (size_t k = 0; k < inActive.size(); k++)
+            active_index(k) = inActive[k];
+        backtracking = oldBacktracking;
+    }
+
     /**
        @brief We need to support assigning the previous state
     */
@@ -72,9 +95,37 @@ class FistaState
     /**
        @brief Total size of the state object
     */
-    static inline uint32_t arraySize (const uint32_t inDimension)
+    static inline uint32_t arraySize (const uint32_t inDimension,
+                                      const uint32_t inNumActive)
+    {
+        return 22 + 4 * inDimension + inNumActive;
+    }
+
+    /**
+       @brief Dot product that only visits the active set
+
+       In active-set iterations, coefficients outside of the active set
+       are zero, so the cost is proportional to the size of the active set
+       instead of the dimension.
+    */
+    template <class Vector>
+    inline double active_dot (Vector& inCoef, MappedColumnVector& inX) const
     {
-        return 21 + 4 * inDimension;
+        double sum = 0;
+        if (use_active_set == 1 && is_active == 1)
+        {
+            for (uint32_t k = 0; k < num_active; k++)
+            {
+                uint32_t i = static_cast<uint32_t>(active_index(k));
+                sum += inCoef(i) * inX(i);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < inX.size(); i++)
+                if (inCoef(i) != 0) sum += inCoef(i) * inX(i);
+        }
+        return sum;
     }
 
   protected:
@@ -106,7 +157,10 @@ class FistaState
         stepsize_sum.rebind(&mStorage[17 + 4 * dimension]);
         gradient_intercept.rebind(&mStorage[18 + 4 * dimension]);
         random_stepsize.rebind(&mStorage[19 + 4 * dimension]);
-        backtracking.rebind(&mStorage[20 + 4 * dimension]);
+        num_active.rebind(&mStorage[20 + 4 * dimension]);
+        active_index.rebind(&mStorage[21 + 4 * dimension], num_active);
+        // the driver function reads backtracking from the last element
+        backtracking.rebind(&mStorage[21 + 4 * dimension + num_active]);
     }
 
     Handle mStorage;
@@ -139,6 +193,8 @@ class FistaState
     typename HandleTraits<Handle>::ReferenceToUInt32 is_active; // is using active-set now?
     typename HandleTraits<Handle>::ReferenceToDouble gradient_intercept; // gradient element for intercept
     typename HandleTraits<Handle>::ReferenceToUInt32 random_stepsize;
+    typename HandleTraits<Handle>::ReferenceToUInt32 num_active; // size of the active set
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap active_index; // indices of the active set
 };
 
 }
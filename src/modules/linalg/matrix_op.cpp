@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <functional>
 #include <numeric>
+#include <vector>
 #include "matrix_op.hpp"
 
 namespace madlib {
@@ -196,6 +197,209 @@ AnyType matrix_mem_trans::run(AnyType & args)
     return r;
 }
 
+/**
+ * @brief Multiply a dense row vector with an in-memory (panel of a) matrix
+ *
+ * The row-major k x m array b is mapped without copying as the column-major
+ * m x k matrix b^T, so the output row a^T b = b^T a is a single matrix-vector
+ * product.
+ */
+AnyType matrix_vec_mem_mult::run(AnyType & args)
+{
+    MappedColumnVector a = args[0].getAs<MappedColumnVector>();
+    MappedMatrix b_trans = args[1].getAs<MappedMatrix>();
+
+    if (a.size() != b_trans.cols()){
+        throw std::invalid_argument(
+            "invalid argument - dimension mismatch");
+    }
+
+    MutableNativeColumnVector r(allocateArray<double>(b_trans.rows()));
+    r.noalias() = b_trans * a;
+    return r;
+}
+
+/**
+ * @brief Pack a sparse matrix given as coordinate lists into CSR form
+ *
+ * The result is the single array
+ * [row_dim, col_dim, nnz, row_ptr[0..row_dim], col_id[0..nnz), value[0..nnz)],
+ * so that it can be passed to matrix_spgemm_row as one value and be read there
+ * without unpacking. Indices are exact in double precision.
+ */
+AnyType matrix_sparse_pack::run(AnyType & args)
+{
+    ArrayHandle<int32_t> rows = args[0].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<int32_t> cols = args[1].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<double> vals = args[2].getAs<ArrayHandle<double> >();
+    int32_t row_dim = args[3].getAs<int32_t>();
+    int32_t col_dim = args[4].getAs<int32_t>();
+
+    if (row_dim < 1 || col_dim < 1){
+        throw std::invalid_argument(
+            "invalid argument - row_dim and col_dim should be positive");
+    }
+
+    if (rows.size() != cols.size() || rows.size() != vals.size()){
+        throw std::invalid_argument(
+            "invalid argument - coordinate arrays should have the same size");
+    }
+
+    size_t nnz = rows.size();
+    MutableArrayHandle<double> csr = madlib_construct_array(
+        NULL, static_cast<int>(3 + row_dim + 1 + 2 * nnz), FLOAT8TI.oid,
+        FLOAT8TI.len, FLOAT8TI.byval, FLOAT8TI.align);
+    double *row_ptr = csr.ptr() + 3;
+    double *col_id = row_ptr + row_dim + 1;
+    double *value = col_id + nnz;
+
+    csr[0] = row_dim;
+    csr[1] = col_dim;
+    csr[2] = static_cast<double>(nnz);
+
+    // Counting sort by row: row_ptr[r + 1] is first the number of entries in
+    // row r, then the start of row r + 1, and finally (after placing all
+    // entries) the end of row r + 1
+    for (size_t i = 0; i < nnz; i++){
+        if (rows[i] < 0 || rows[i] >= row_dim ||
+                cols[i] < 0 || cols[i] >= col_dim){
+            throw std::invalid_argument(
+                "invalid argument - row and col should be in the range of "
+                "[0, row_dim) and [0, col_dim)");
+        }
+        row_ptr[rows[i] + 1]++;
+    }
+    for (int32_t r = 0; r < row_dim; r++)
+        row_ptr[r + 1] += row_ptr[r];
+
+    std::vector<size_t> next(row_ptr, row_ptr + row_dim);
+    for (size_t i = 0; i < nnz; i++){
+        size_t pos = next[rows[i]]++;
+        col_id[pos] = cols[i];
+        value[pos] = vals[i];
+    }
+
+    return csr;
+}
+
+/**
+ * @brief One row of a sparse-sparse matrix product (Gustavson's algorithm)
+ *
+ * The row of A is given by the column ids and values of its nonzeros, B is
+ * the CSR array created by matrix_sparse_pack. The output row is the linear
+ * combination of the rows of B selected by the nonzeros of A. It is
+ * accumulated either in a dense array of length col_dim, or, if the number of
+ * partial products is small compared to col_dim, by sorting the partial
+ * products by column. The result is the n x 2 array of (col_id, value) pairs
+ * of the nonzeros of the output row, in increasing column order, or NULL if
+ * the output row is empty.
+ */
+AnyType matrix_spgemm_row::run(AnyType & args)
+{
+    ArrayHandle<int32_t> a_cols = args[0].getAs<ArrayHandle<int32_t> >();
+    ArrayHandle<double> a_vals = args[1].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> csr = args[2].getAs<ArrayHandle<double> >();
+
+    if (a_cols.size() != a_vals.size()){
+        throw std::invalid_argument(
+            "invalid argument - coordinate arrays should have the same size");
+    }
+    if (csr.size() < 4){
+        throw std::invalid_argument(
+            "invalid argument - malformed packed sparse matrix");
+    }
+
+    int32_t row_dim = static_cast<int32_t>(csr[0]);
+    int32_t col_dim = static_cast<int32_t>(csr[1]);
+    size_t nnz = static_cast<size_t>(csr[2]);
+    const double *row_ptr = csr.ptr() + 3;
+    const double *col_id = row_ptr + row_dim + 1;
+    const double *value = col_id + nnz;
+
+    size_t flops = 0;
+    for (size_t i = 0; i < a_cols.size(); i++){
+        if (a_cols[i] < 0 || a_cols[i] >= row_dim){
+            throw std::invalid_argument(
+                "invalid argument - dimension mismatch");
+        }
+        flops += static_cast<size_t>(
+            row_ptr[a_cols[i] + 1] - row_ptr[a_cols[i]]);
+    }
+
+    ScratchArena& scratch = args.getScratchArena();
+    scratch.reset();
+
+    // Column ids and values of the nonzeros of the output row
+    int32_t *out_cols = scratch.allocateArray<int32_t>(
+        std::min(flops, static_cast<size_t>(col_dim)));
+    double *out_vals = scratch.allocateArray<double>(
+        std::min(flops, static_cast<size_t>(col_dim)));
+    size_t n = 0;
+
+    if (flops * 4 >= static_cast<size_t>(col_dim)){
+        double *acc = scratch.allocateArray<double>(col_dim);
+        char *touched = scratch.allocateArray<char>(col_dim);
+        std::fill(acc, acc + col_dim, 0.);
+        std::fill(touched, touched + col_dim, 0);
+
+        for (size_t i = 0; i < a_cols.size(); i++){
+            size_t end = static_cast<size_t>(row_ptr[a_cols[i] + 1]);
+            for (size_t j = static_cast<size_t>(row_ptr[a_cols[i]]);
+                    j < end; j++){
+                int32_t c = static_cast<int32_t>(col_id[j]);
+                acc[c] += a_vals[i] * value[j];
+                touched[c] = 1;
+            }
+        }
+
+        for (int32_t c = 0; c < col_dim; c++){
+            if (touched[c]){
+                out_cols[n] = c;
+                out_vals[n] = acc[c];
+                n++;
+            }
+        }
+    } else {
+        std::pair<int32_t, double> *products =
+            scratch.allocateArray<std::pair<int32_t, double> >(flops);
+        size_t f = 0;
+        for (size_t i = 0; i < a_cols.size(); i++){
+            size_t end = static_cast<size_t>(row_ptr[a_cols[i] + 1]);
+            for (size_t j = static_cast<size_t>(row_ptr[a_cols[i]]);
+                    j < end; j++){
+                products[f++] = std::make_pair(
+                    static_cast<int32_t>(col_id[j]), a_vals[i] * value[j]);
+            }
+        }
+        std::sort(products, products + flops);
+
+        for (f = 0; f < flops; f++){
+            if (f == 0 || products[f].first != products[f - 1].first){
+                out_cols[n] = products[f].first;
+                out_vals[n] = 0.;
+                n++;
+            }
+            out_vals[n - 1] += products[f].second;
+        }
+    }
+
+    // An empty row has no representation as a 2-d array
+    if (n == 0)
+        return Null();
+
+    int dims[2] = {static_cast<int>(n), 2};
+    int lbs[2] = {1, 1};
+    MutableArrayHandle<double> r = madlib_construct_md_array(
+            NULL, NULL, 2, dims, lbs, FLOAT8TI.oid,
+            FLOAT8TI.len, FLOAT8TI.byval, FLOAT8TI.align);
+    for (size_t k = 0; k < n; k++){
+        r[2 * k] = out_cols[k];
+        r[2 * k + 1] = out_vals[k];
+    }
+
+    return r;
+}
+
 AnyType rand_vector::run(AnyType & args)
 {
     int dim = args[0].getAs<int>();
@@ -6,6 +6,9 @@
 
 DECLARE_UDF(linalg, matrix_mem_mult)
 DECLARE_UDF(linalg, matrix_mem_trans)
+DECLARE_UDF(linalg, matrix_vec_mem_mult)
+DECLARE_UDF(linalg, matrix_sparse_pack)
+DECLARE_UDF(linalg, matrix_spgemm_row)
 
 DECLARE_UDF(linalg, matrix_densify_sfunc)
 DECLARE_UDF(linalg, matrix_blockize_sfunc)
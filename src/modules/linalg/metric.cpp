@@ -34,6 +34,71 @@ struct ReverseLexicographicComparator {
     }
 };
 
+/**
+ * @brief Select the k smallest of a sequence of distances
+ *
+ * @param inNumDistances Number \f$ n \f$ of distances
+ * @param inDistance Function object, where <tt>inDistance(i)</tt> is the
+ *     distance \f$ d_i \f$ between column \f$ i \f$ and the point of
+ *     interest. It is called exactly once for each \f$ i < n \f$.
+ * @param[out] ioFirst, ioLast Range of (at most \f$ n \f$) (index, distance)
+ *     pairs that will be sorted in ascending order of distance. In case of
+ *     ties, smaller indices come first.
+ */
+template <class DistanceAccessor, class RandomAccessIterator>
+void
+closestFromDistances(
+    Index inNumDistances,
+    const DistanceAccessor& inDistance,
+    RandomAccessIterator ioFirst,
+    RandomAccessIterator ioLast) {
+
+    ReverseLexicographicComparator<
+        typename std::iterator_traits<RandomAccessIterator>::value_type>
+            comparator;
+
+    if (ioFirst == ioLast)
+        return;
+
+    std::fill(ioFirst, ioLast,
+        std::make_tuple(0, std::numeric_limits<double>::infinity()));
+    for (Index i = 0; i < inNumDistances; ++i) {
+        double currentDist = inDistance(i);
+
+        // [ioFirst, ioLast) is a heap, so the first element is maximal
+        if (currentDist < std::get<1>(*ioFirst)) {
+            // Unfortunately, the STL does not have a decrease-key function,
+            // so we are wasting a bit of performance here
+            std::pop_heap(ioFirst, ioLast, comparator);
+            *(ioLast - 1) = std::make_tuple(i, currentDist);
+            std::push_heap(ioFirst, ioLast, comparator);
+        }
+    }
+    std::sort_heap(ioFirst, ioLast, comparator);
+}
+
+/**
+ * @brief Distances between the columns of a matrix and a vector, computed on
+ *     demand with the given distance function
+ */
+template <class DistanceFunction>
+class ColumnDistances {
+public:
+    ColumnDistances(const MappedMatrix& inMatrix,
+        const MappedColumnVector& inVector, DistanceFunction& inMetric)
+      : mMatrix(inMatrix), mVector(inVector), mMetric(inMetric) { }
+
+    double operator()(Index inColumn) const {
+        return AnyType_cast<double>(
+            mMetric(MappedColumnVector(mMatrix.col(inColumn)), mVector));
+    }
+
+private:
+    const MappedMatrix& mMatrix;
+    const MappedColumnVector& mVector;
+    DistanceFunction& mMetric;
+};
+
 } // anonymous namespace
 
 /**
@@ -62,28 +127,8 @@ closestColumnsAndDistances(
     RandomAccessIterator ioFirst,
     RandomAccessIterator ioLast) {
 
-    ReverseLexicographicComparator<
-        typename std::iterator_traits<RandomAccessIterator>::value_type>
-            comparator;
-
-    std::fill(ioFirst, ioLast,
-        std::make_tuple(0, std::numeric_limits<double>::infinity()));
-    for (Index i = 0; i < inMatrix.cols(); ++i) {
-        double currentDist
-            = AnyType_cast<double>(
-                inMetric(MappedColumnVector(inMatrix.col(i)), inVector)
-            );
-
-        // outIndicesAndDistances is a heap, so the first element is maximal
-        if (currentDist < std::get<1>(*ioFirst)) {
-            // Unfortunately, the STL does not have a decrease-key function,
-            // so we are wasting a bit of performance here
-            std::pop_heap(ioFirst, ioLast, comparator);
-            *(ioLast - 1) = std::make_tuple(i, currentDist);
-            std::push_heap(ioFirst, ioLast, comparator);
-        }
-    }
-    std::sort_heap(ioFirst, ioLast, comparator);
+    ColumnDistances<DistanceFunction> distances(inMatrix, inVector, inMetric);
+    closestFromDistances(inMatrix.cols(), distances, ioFirst, ioLast);
 }
 
 double
@@ -175,18 +220,106 @@ closestColumnsAndDistancesShortcut(
     else if (inDist.funcPtr() == funcPtr<dist_tanimoto>())
         closestColumnsAndDistances(inMatrix, inVector, distTanimoto,
             ioFirst, ioLast);
-    else
+    else {
+        // An arbitrary distance function is called once per column, so its
+        // memory has to be freed after each call
+        inDist.setFunctionCallOptions(inDist.getFunctionCallOptions()
+            | FunctionHandle::GarbageCollectionAfterCall);
         closestColumnsAndDistances(inMatrix, inVector, inDist,
             ioFirst, ioLast);
+    }
+}
+
+/**
+ * @brief Compute, for each column of a block of points, the k columns of a
+ *     matrix that are closest
+ *
+ * For the (squared) Euclidean distance and the angle, all inner products
+ * between points and columns are obtained with a single matrix product
+ * \f$ M^T X \f$. Distances then follow from
+ * \f$ \| \vec x - \vec m \|^2
+ *     = \| \vec x \|^2 - 2 \vec x^T \vec m + \| \vec m \|^2 \f$ and
+ * \f$ \cos \angle(\vec x, \vec m)
+ *     = \vec x^T \vec m / (\| \vec x \| \| \vec m \|) \f$, respectively.
+ * For all other distance functions, we fall back to comparing one point at a
+ * time.
+ *
+ * @param inMatrix Matrix \f$ M \f$
+ * @param inPoints Matrix \f$ X \f$ whose columns are the points
+ * @param inDist The distance function
+ * @param[out] ioFirst, ioLast Range of \f$ n \cdot k \f$ (index, distance)
+ *     pairs, where \f$ n \f$ is the number of points. The \f$ k \f$ pairs
+ *     for the \f$ i \f$-th point start at <tt>ioFirst + i * k</tt>.
+ */
+template <class RandomAccessIterator>
+void
+closestColumnsAndDistancesBlock(
+    const MappedMatrix& inMatrix,
+    const MappedMatrix& inPoints,
+    FunctionHandle &inDist,
+    RandomAccessIterator ioFirst,
+    RandomAccessIterator ioLast) {
+
+    Index num = (ioLast - ioFirst) / std::max(inPoints.cols(), Index(1));
+    bool isSquaredDistNorm2
+        = inDist.funcPtr() == funcPtr<squared_dist_norm2>();
+    bool isDistNorm2 = inDist.funcPtr() == funcPtr<dist_norm2>();
+    bool isDistAngle = inDist.funcPtr() == funcPtr<dist_angle>();
+
+    if (!isSquaredDistNorm2 && !isDistNorm2 && !isDistAngle) {
+        for (Index i = 0; i < inPoints.cols(); ++i)
+            closestColumnsAndDistancesShortcut(inMatrix,
+                MappedColumnVector(inPoints.col(i)), inDist,
+                ioFirst + i * num, ioFirst + (i + 1) * num);
+        return;
+    }
+
+    // The only matrix product. Column i contains the inner products between
+    // point i and all columns of inMatrix.
+    Matrix dist = trans(inMatrix) * inPoints;
+    ColumnVector columnSquaredNorms
+        = trans(inMatrix.colwise().squaredNorm());
+
+    for (Index i = 0; i < inPoints.cols(); ++i) {
+        double pointSquaredNorm = inPoints.col(i).squaredNorm();
+
+        if (isDistAngle) {
+            // Same conventions as distAngle()
+            double pointNorm = std::sqrt(pointSquaredNorm);
+            for (Index j = 0; j < dist.rows(); ++j) {
+                double columnNorm = std::sqrt(columnSquaredNorms(j));
+                if (pointNorm < std::numeric_limits<double>::denorm_min()
+                    || columnNorm < std::numeric_limits<double>::denorm_min()) {
+                    dist(j, i) = std::acos(-1);
+                    continue;
+                }
+                double cosine = dist(j, i) / (pointNorm * columnNorm);
+                if (cosine > 1)
+                    cosine = 1;
+                else if (cosine < -1)
+                    cosine = -1;
+                dist(j, i) = std::acos(cosine);
+            }
+        } else {
+            // Cancellation may produce tiny negative values
+            dist.col(i) = (columnSquaredNorms.array() - 2 * dist.col(i).array()
+                + pointSquaredNorm).max(0.);
+            if (isDistNorm2)
+                dist.col(i) = dist.col(i).cwiseSqrt();
+        }
+
+        closestFromDistances(dist.rows(), dist.col(i), ioFirst + i * num,
+            ioFirst + (i + 1) * num);
+    }
 }
 
 /**
  * @brief Compute the minimum distance between a vector and any column of a
  *     matrix
  *
- * This function calls a user-supplied function, for which it does not do
- * garbage collection. It is therefore meant to be called only constantly many
- * times before control is returned to the backend.
+ * Distance functions other than those in
+ * closestColumnsAndDistancesShortcut() are called with garbage collection
+ * after each call.
  */
 AnyType
 closest_column::run(AnyType& args) {
@@ -208,9 +341,9 @@ closest_column::run(AnyType& args) {
  * @brief Compute the minimum distance between a vector and any column of a
  *     matrix
  *
- * This function calls a user-supplied function, for which it does not do
- * garbage collection. It is therefore meant to be called only constantly many
- * times before control is returned to the backend.
+ * Distance functions other than those in
+ * closestColumnsAndDistancesShortcut() are called with garbage collection
+ * after each call.
  */
 AnyType
 closest_columns::run(AnyType& args) {
@@ -235,6 +368,70 @@ closest_columns::run(AnyType& args) {
     return tuple << indices << distances;
 }
 
+/**
+ * @brief For each point in a block, compute the closest column of a matrix
+ *
+ * The block of points is passed as a two-dimensional array with one point per
+ * row. See closestColumnsAndDistancesBlock() for the distance functions that
+ * are computed with a single matrix product.
+ */
+AnyType
+closest_column_block::run(AnyType& args) {
+    MappedMatrix M = args[0].getAs<MappedMatrix>();
+    MappedMatrix X = args[1].getAs<MappedMatrix>();
+    FunctionHandle dist = args[2].getAs<FunctionHandle>()
+        .unsetFunctionCallOptions(FunctionHandle::GarbageCollectionAfterCall);
+
+    if (M.rows() != X.rows())
+        throw std::invalid_argument("Invalid arguments: Dimensions of points "
+            "and matrix columns are not consistent.");
+
+    std::vector<std::tuple<Index, double> > result(X.cols());
+    closestColumnsAndDistancesBlock(M, X, dist, result.begin(), result.end());
+
+    MutableArrayHandle<int32_t> indices = allocateArray<int32_t,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(X.cols());
+    MutableArrayHandle<double> distances = allocateArray<double,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(X.cols());
+    for (Index i = 0; i < X.cols(); ++i)
+        std::tie(indices[i], distances[i]) = result[i];
+
+    AnyType tuple;
+    return tuple << indices << distances;
+}
+
+/**
+ * @brief For each point in a block, compute the closest columns of a matrix
+ *
+ * The result arrays are two-dimensional, with one row per point.
+ */
+AnyType
+closest_columns_block::run(AnyType& args) {
+    MappedMatrix M = args[0].getAs<MappedMatrix>();
+    MappedMatrix X = args[1].getAs<MappedMatrix>();
+    uint32_t num = args[2].getAs<uint32_t>();
+    FunctionHandle dist = args[3].getAs<FunctionHandle>()
+        .unsetFunctionCallOptions(FunctionHandle::GarbageCollectionAfterCall);
+
+    if (M.rows() != X.rows())
+        throw std::invalid_argument("Invalid arguments: Dimensions of points "
+            "and matrix columns are not consistent.");
+
+    std::vector<std::tuple<Index, double> > result(X.cols() * num);
+    closestColumnsAndDistancesBlock(M, X, dist, result.begin(), result.end());
+
+    MutableArrayHandle<int32_t> indices = allocateArray<int32_t,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+            X.cols(), num);
+    MutableArrayHandle<double> distances = allocateArray<double,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+            X.cols(), num);
+    for (size_t i = 0; i < result.size(); ++i)
+        std::tie(indices[i], distances[i]) = result[i];
+
+    AnyType tuple;
+    return tuple << indices << distances;
+}
 
 AnyType
 norm1::run(AnyType& args) {
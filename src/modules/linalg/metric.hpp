@@ -14,6 +14,16 @@ DECLARE_UDF(linalg, closest_column)
  */
 DECLARE_UDF(linalg, closest_columns)
 
+/**
+ * @brief Find, for each point in a block, the closest column in a matrix
+ */
+DECLARE_UDF(linalg, closest_column_block)
+
+/**
+ * @brief Find, for each point in a block, the closest columns in a matrix
+ */
+DECLARE_UDF(linalg, closest_columns_block)
+
 
 /**
  * @brief Compute the 1-norm
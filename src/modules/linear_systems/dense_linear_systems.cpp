@@ -268,19 +268,11 @@ dense_direct_linear_system_transition::run(AnyType &args) {
     state.numRows++;
 	  
 	// Now do the transition step
-	// First we create a block of zeros in memory
-	// and then add the vector in the appropriate position
-    ColumnVector bvec(static_cast<uint32_t>(state.widthOfb));
-    Matrix Amat(static_cast<uint32_t>(state.widthOfb),
-                static_cast<uint32_t>(state.widthOfA));
-    bvec.setZero();
-    Amat.setZero();
-    bvec(row_id) = _b;
-    Amat.row(row_id) = _a;
-
-    // Build the vector & matrices based on row_id
-    state.A += Amat;
-    state.b += bvec;
+	// Add the row in the appropriate position. Only one row of A and one
+	// element of b change, so there is no need for temporaries of the size
+	// of the whole system.
+    state.A.row(row_id) += trans(_a);
+    state.b(row_id) += _b;
     return state;
 }
 
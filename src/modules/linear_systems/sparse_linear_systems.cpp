@@ -240,32 +240,17 @@ sparse_direct_linear_system_transition::run(AnyType &args) {
     }
 
 	// Now do the transition step
-	// First we create a block of zeros in memory
-	// and then add the vector in the appropriate position
-    ColumnVector bvec(static_cast<uint32_t>(state.numEquations));
-    ColumnVector rvec(static_cast<uint32_t>(state.NNZA));
-    ColumnVector cvec(static_cast<uint32_t>(state.NNZA));
-    ColumnVector vvec(static_cast<uint32_t>(state.NNZA));
-    
-    bvec.setZero();
-    rvec.setZero();
-    cvec.setZero();
-    vvec.setZero();
-
-    rvec(state.nnz_processed) = row_id;
-    cvec(state.nnz_processed) = col_id;
-    vvec(state.nnz_processed) = value;
-
+	// Add the entry in the appropriate position. Only single elements change,
+	// so there is no need for temporaries of the size of the whole system.
     if (state.b_stored(row_id) == 0) {
-        bvec(row_id) = _b;
+        state.b(row_id) += _b;
         state.b_stored(row_id) = 1; 
-        state.b += bvec;
     }
 
     // Build the vector & matrices based on row_id
-    state.r += rvec;
-    state.c += cvec;
-    state.v += vvec;
+    state.r(state.nnz_processed) += row_id;
+    state.c(state.nnz_processed) += col_id;
+    state.v(state.nnz_processed) += value;
     state.nnz_processed++;
 
     return state;
@@ -597,32 +582,17 @@ sparse_inmem_iterative_linear_system_transition::run(AnyType &args) {
     }
 
 	// Now do the transition step
-	// First we create a block of zeros in memory
-	// and then add the vector in the appropriate position
-    ColumnVector bvec(static_cast<uint32_t>(state.numEquations));
-    ColumnVector rvec(static_cast<uint32_t>(state.NNZA));
-    ColumnVector cvec(static_cast<uint32_t>(state.NNZA));
-    ColumnVector vvec(static_cast<uint32_t>(state.NNZA));
-    
-    bvec.setZero();
-    rvec.setZero();
-    cvec.setZero();
-    vvec.setZero();
-
-    rvec(state.nnz_processed) = row_id;
-    cvec(state.nnz_processed) = col_id;
-    vvec(state.nnz_processed) = value;
-
+	// Add the entry in the appropriate position. Only single elements change,
+	// so there is no need for temporaries of the size of the whole system.
     if (state.b_stored(row_id) == 0) {
-        bvec(row_id) = _b;
+        state.b(row_id) += _b;
         state.b_stored(row_id) = 1; 
-        state.b += bvec;
     }
 
     // Build the vector & matrices based on row_id
-    state.r += rvec;
-    state.c += cvec;
-    state.v += vvec;
+    state.r(state.nnz_processed) += row_id;
+    state.c(state.nnz_processed) += col_id;
+    state.v(state.nnz_processed) += value;
     state.nnz_processed++;
 
     return state;
@@ -100,6 +100,52 @@ LinearRegressionAccumulator<Container>::operator<<(const tuple_type& inTuple) {
     return *this;
 }
 
+/**
+ * @brief Update the accumulation state with a block of rows
+ *
+ * The block consists of a matrix whose columns are the independent-variable
+ * vectors \f$ \boldsymbol x_i \f$ (i.e., the transpose of the design matrix
+ * of the block) and the vector of dependent variables. Instead of one rank-1
+ * update per row, \f$ X^T X \f$ is updated with a single rank-k update and
+ * \f$ X^T \boldsymbol y \f$ with a single matrix-vector product.
+ */
+template <class Container>
+inline
+LinearRegressionAccumulator<Container>&
+LinearRegressionAccumulator<Container>::operator<<(const block_type& inBlock) {
+    const MappedMatrix& X = std::get<0>(inBlock);
+    const MappedColumnVector& y = std::get<1>(inBlock);
+
+    if (X.cols() != y.size())
+        throw std::invalid_argument("Number of dependent variables does not "
+            "match the number of rows in the block.");
+    else if (!dbal::eigen_integration::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!dbal::eigen_integration::isfinite(X))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (X.rows() > std::numeric_limits<uint16_t>::max())
+        throw std::domain_error("Number of independent variables cannot be "
+            "larger than 65535.");
+
+    // Initialize in first iteration
+    if (numRows == 0) {
+        widthOfX = static_cast<uint16_t>(X.rows());
+        this->resize();
+    } else if (widthOfX != static_cast<uint16_t>(X.rows())) {
+        throw std::runtime_error("Inconsistent numbers of independent "
+            "variables.");
+    }
+
+    numRows += static_cast<uint64_t>(X.cols());
+    y_sum += y.sum();
+    y_square_sum += y.squaredNorm();
+    X_transp_Y.noalias() += X * y;
+
+    // As in the row-wise update, only the lower triangular part is filled
+    X_transp_X.template selfadjointView<Eigen::Lower>().rankUpdate(X);
+    return *this;
+}
+
 /**
  * @brief Merge with another accumulation state
  */
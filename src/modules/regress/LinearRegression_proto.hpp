@@ -24,10 +24,12 @@ public:
     typedef DynamicStruct<LinearRegressionAccumulator, Container> Base;
     MADLIB_DYNAMIC_STRUCT_TYPEDEFS;
     typedef std::tuple<MappedColumnVector, double> tuple_type;
+    typedef std::tuple<MappedMatrix, MappedColumnVector> block_type;
 
     LinearRegressionAccumulator(Init_type& inInitialization);
     void bind(ByteStream_type& inStream);
     LinearRegressionAccumulator& operator<<(const tuple_type& inTuple);
+    LinearRegressionAccumulator& operator<<(const block_type& inBlock);
     template <class OtherContainer> LinearRegressionAccumulator& operator<<(
         const LinearRegressionAccumulator<OtherContainer>& inOther);
     template <class OtherContainer> LinearRegressionAccumulator& operator=(
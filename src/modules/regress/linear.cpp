@@ -41,6 +41,24 @@ linregr_transition::run(AnyType& args) {
     return state.storage();
 }
 
+/**
+ * @brief Block transition: Process a whole block of rows in one call
+ *
+ * args[1] is the array of dependent variables and args[2] the two-dimensional
+ * array whose i-th row holds the independent variables of the i-th row of the
+ * block. The fixed per-call overhead (argument conversion, state rebinding) is
+ * therefore paid once per block instead of once per row.
+ */
+AnyType
+linregr_block_transition::run(AnyType& args) {
+    MutableLinRegrState state = args[0].getAs<MutableByteString>();
+    MappedColumnVector y = args[1].getAs<MappedColumnVector>();
+    MappedMatrix X = args[2].getAs<MappedMatrix>();
+
+    state << MutableLinRegrState::block_type(X, y);
+    return state.storage();
+}
+
 AnyType
 linregr_merge_states::run(AnyType& args) {
     MutableLinRegrState stateLeft = args[0].getAs<MutableByteString>();
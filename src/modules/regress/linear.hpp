@@ -9,6 +9,11 @@
  */
 DECLARE_UDF(regress, linregr_transition)
 
+/**
+ * @brief Linear regression: Transition function for a block of rows
+ */
+DECLARE_UDF(regress, linregr_block_transition)
+
 /**
  * @brief Linear regression: State merge function
  */
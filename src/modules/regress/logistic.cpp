@@ -4,10 +4,12 @@
  *
  * @brief Logistic-Regression functions
  *
- * We implement the conjugate-gradient method and the iteratively-reweighted-
- * least-squares method.
+ * We implement the conjugate-gradient method, the iteratively-reweighted-
+ * least-squares method, and the limited-memory BFGS method.
  *
  *//* ----------------------------------------------------------------------- */
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <dbconnector/dbconnector.hpp>
 #include <modules/shared/HandleTraits.hpp>
@@ -487,7 +489,8 @@ public:
 
 private:
     static inline uint32_t arraySize(const uint16_t inWidthOfX) {
-        return 4 + inWidthOfX * inWidthOfX + 2 * inWidthOfX;
+        return static_cast<uint32_t>(4 + packedTriangleSize(inWidthOfX)
+            + 2 * inWidthOfX);
     }
 
     /**
@@ -503,17 +506,25 @@ private:
      * Intra-iteration components (updated in transition step):
      * - 1 + widthOfX: numRows (number of rows already processed in this iteration)
      * - 2 + widthOfX: X_transp_Az (X^T A z)
-     * - 2 + 2 * widthOfX: X_transp_AX (X^T A X)
-     * - 2 + widthOfX^2 + 2 * widthOfX: logLikelihood ( ln(l(c)) )
+     * - 2 + 2 * widthOfX: X_transp_AX (X^T A X, packed lower triangle of
+     *   size T = widthOfX * (widthOfX + 1) / 2)
+     * - 2 + T + 2 * widthOfX: logLikelihood ( ln(l(c)) )
+     * - 3 + T + 2 * widthOfX: status
+     *
+     * X^T A X is symmetric, so storing only one triangle halves the state
+     * that has to be shipped between segments in every merge.
      */
     void rebind(uint16_t inWidthOfX = 0) {
+        const uint32_t T = static_cast<uint32_t>(
+            packedTriangleSize(inWidthOfX));
+
         widthOfX.rebind(&mStorage[0]);
         coef.rebind(&mStorage[1], inWidthOfX);
         numRows.rebind(&mStorage[1 + inWidthOfX]);
         X_transp_Az.rebind(&mStorage[2 + inWidthOfX], inWidthOfX);
-        X_transp_AX.rebind(&mStorage[2 + 2 * inWidthOfX], inWidthOfX, inWidthOfX);
-        logLikelihood.rebind(&mStorage[2 + inWidthOfX * inWidthOfX + 2 * inWidthOfX]);
-        status.rebind(&mStorage[3 + inWidthOfX * inWidthOfX + 2 * inWidthOfX]);
+        X_transp_AX.rebind(&mStorage[2 + 2 * inWidthOfX], T);
+        logLikelihood.rebind(&mStorage[2 + T + 2 * inWidthOfX]);
+        status.rebind(&mStorage[3 + T + 2 * inWidthOfX]);
     }
 
     Handle mStorage;
@@ -524,7 +535,7 @@ public:
 
     typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_Az;
-    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_AX;
     typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
     typename HandleTraits<Handle>::ReferenceToUInt16 status;
 
@@ -583,8 +594,7 @@ AnyType logregr_irls_step_transition::run(AnyType &args) {
     double az = xc * a + sigma(-y * xc) * y;
 
     state.X_transp_Az.noalias() += x * az;
-    //triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
-    state.X_transp_AX += x * trans(x) * a;
+    packedRankUpdate(state.X_transp_AX, x, a);
 
     //          n
     //         --
@@ -642,7 +652,8 @@ AnyType logregr_irls_step_final::run(AnyType &args) {
     }
 
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        unpackSymmetric(state.X_transp_AX, state.widthOfX),
+        EigenvaluesOnly, ComputePseudoInverse);
 
     // Precompute (X^T * A * X)^+
     Matrix inverse_of_X_transp_AX = decomposition.pseudoInverse();
@@ -665,7 +676,7 @@ AnyType logregr_irls_step_final::run(AnyType &args) {
     // Likewise, we store the condition number.
     // FIXME: This feels a bit like a hack.
     state.X_transp_Az = inverse_of_X_transp_AX.diagonal();
-    state.X_transp_AX(0,0) = decomposition.conditionNo();
+    state.X_transp_AX(0) = decomposition.conditionNo();
 
     return state;
 }
@@ -689,7 +700,7 @@ AnyType internal_logregr_irls_result::run(AnyType &args) {
     LogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
 
     return stateToResult(*this, state.coef,
-                         state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0,0),
+                         state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0),
                          state.status);
 }
 
@@ -975,6 +986,487 @@ internal_logregr_igd_result::run(AnyType &args) {
                          decomposition.conditionNo(), state.status);
 }
 
+/**
+ * @brief Inter- and intra-iteration state for the limited-memory BFGS method
+ *        for logistic regression
+ *
+ * In contrast to the IRLS and conjugate-gradient states, this state does not
+ * contain \f$ X^T A X \f$. Each iteration only accumulates the log-likelihood
+ * and the gradient at a trial point, so the work per row and the size of the
+ * state are linear in the number of independent variables. The curvature
+ * information is kept in the last \c historySize correction pairs
+ * \f$ (s_k, y_k) \f$, which are updated in the final function.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 2, and all elemenets are 0.
+ */
+template <class Handle>
+class LogRegrLBFGSTransitionState {
+    template <class OtherHandle>
+    friend class LogRegrLBFGSTransitionState;
+
+public:
+    LogRegrLBFGSTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[0]),
+            static_cast<uint16_t>(mStorage[1]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the L-BFGS state.
+     *
+     * This function is only called for the first iteration, for the first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX,
+        uint16_t inHistorySize) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inHistorySize));
+        rebind(inWidthOfX, inHistorySize);
+        widthOfX = inWidthOfX;
+        historySize = inHistorySize;
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    LogRegrLBFGSTransitionState &operator=(
+        const LogRegrLBFGSTransitionState<OtherHandle> &inOtherState) {
+
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another State object by copying the intra-iteration
+     *     fields
+     */
+    template <class OtherHandle>
+    LogRegrLBFGSTransitionState &operator+=(
+        const LogRegrLBFGSTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        gradNew += inOtherState.gradNew;
+        logLikelihoodNew += inOtherState.logLikelihoodNew;
+        // merged state should have the higher status
+        // (see top of file for more on 'status' )
+        status = (inOtherState.status > status) ? inOtherState.status : status;
+        return *this;
+    }
+
+    /**
+     * @brief Reset the inter-iteration fields.
+     */
+    inline void reset() {
+        numRows = 0;
+        gradNew.fill(0);
+        logLikelihoodNew = 0;
+        status = IN_PROCESS;
+    }
+
+    /**
+     * @brief Multiply a vector with the L-BFGS approximation of the inverse
+     *     of \f$ X^T A X \f$ (two-loop recursion)
+     */
+    ColumnVector inverseHessianTimes(const ColumnVector &inVec) const {
+        ColumnVector q = inVec;
+        ColumnVector a(historySize);
+        double gamma = 1.;
+
+        for (uint16_t k = 0; k < numPairs; k++) {
+            uint16_t i = static_cast<uint16_t>(
+                (newestPair + historySize - k) % historySize);
+            a(i) = dot(S.col(i), q) / dot(Y.col(i), S.col(i));
+            q -= a(i) * Y.col(i);
+        }
+        if (numPairs > 0)
+            gamma = dot(S.col(newestPair), Y.col(newestPair))
+                / Y.col(newestPair).squaredNorm();
+        q *= gamma;
+        for (uint16_t k = numPairs; k > 0; k--) {
+            uint16_t i = static_cast<uint16_t>(
+                (newestPair + historySize - k + 1) % historySize);
+            double b = dot(Y.col(i), q) / dot(Y.col(i), S.col(i));
+            q += (a(i) - b) * S.col(i);
+        }
+        return q;
+    }
+
+private:
+    static inline uint32_t arraySize(const uint16_t inWidthOfX,
+        const uint16_t inHistorySize) {
+
+        return 12 + 5 * inWidthOfX + 2 * inHistorySize * inWidthOfX;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of independent variables.
+     * @param inHistorySize The number of correction pairs kept.
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: widthOfX (number of coefficients)
+     * - 1: historySize (maximum number of correction pairs)
+     * - 2: iteration (current iteration)
+     * - 3: numPairs (number of correction pairs stored)
+     * - 4: newestPair (column of the most recent correction pair)
+     * - 5: stepsize (step size of the pending trial point)
+     * - 6: accepted (whether the last trial point was accepted)
+     * - 7: logLikelihood ( ln(l(c)) at the accepted coefficients)
+     * - 8: coef (accepted coefficients)
+     * - 8 + widthOfX: grad (gradient at the accepted coefficients)
+     * - 8 + 2 * widthOfX: dir (search direction)
+     * - 8 + 3 * widthOfX: trialCoef (coef + stepsize * dir)
+     * - 8 + 4 * widthOfX: S (coefficient differences, one per column)
+     * - 8 + (4 + historySize) * widthOfX: Y (gradient differences)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 8 + (4 + 2 * historySize) * widthOfX: numRows (number of rows already
+     *   processed in this iteration)
+     * - 9 + (4 + 2 * historySize) * widthOfX: gradNew (gradient at trialCoef)
+     * - 9 + (5 + 2 * historySize) * widthOfX: logLikelihoodNew (at trialCoef)
+     * - 10 + (5 + 2 * historySize) * widthOfX: status
+     */
+    void rebind(uint16_t inWidthOfX, uint16_t inHistorySize) {
+        uint32_t history = static_cast<uint32_t>(inHistorySize) * inWidthOfX;
+
+        widthOfX.rebind(&mStorage[0]);
+        historySize.rebind(&mStorage[1]);
+        iteration.rebind(&mStorage[2]);
+        numPairs.rebind(&mStorage[3]);
+        newestPair.rebind(&mStorage[4]);
+        stepsize.rebind(&mStorage[5]);
+        accepted.rebind(&mStorage[6]);
+        logLikelihood.rebind(&mStorage[7]);
+        coef.rebind(&mStorage[8], inWidthOfX);
+        grad.rebind(&mStorage[8 + inWidthOfX], inWidthOfX);
+        dir.rebind(&mStorage[8 + 2 * inWidthOfX], inWidthOfX);
+        trialCoef.rebind(&mStorage[8 + 3 * inWidthOfX], inWidthOfX);
+        S.rebind(&mStorage[8 + 4 * inWidthOfX], inWidthOfX, inHistorySize);
+        Y.rebind(&mStorage[8 + 4 * inWidthOfX + history], inWidthOfX,
+            inHistorySize);
+        numRows.rebind(&mStorage[8 + 4 * inWidthOfX + 2 * history]);
+        gradNew.rebind(&mStorage[9 + 4 * inWidthOfX + 2 * history], inWidthOfX);
+        logLikelihoodNew.rebind(&mStorage[9 + 5 * inWidthOfX + 2 * history]);
+        status.rebind(&mStorage[10 + 5 * inWidthOfX + 2 * history]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt16 historySize;
+    typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+    typename HandleTraits<Handle>::ReferenceToUInt16 numPairs;
+    typename HandleTraits<Handle>::ReferenceToUInt16 newestPair;
+    typename HandleTraits<Handle>::ReferenceToDouble stepsize;
+    typename HandleTraits<Handle>::ReferenceToUInt16 accepted;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap grad;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap dir;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap trialCoef;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap S;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap Y;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap gradNew;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihoodNew;
+    typename HandleTraits<Handle>::ReferenceToUInt16 status;
+};
+
+/**
+ * @brief Perform the logistic-regression transition step
+ *
+ * Only the log-likelihood and its gradient at the trial point are
+ * accumulated, which costs O(widthOfX) per row.
+ */
+AnyType
+logregr_lbfgs_step_transition::run(AnyType &args) {
+    LogRegrLBFGSTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+
+    if (!x.is_finite()){
+        dberr << "Design matrix is not finite." << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max()){
+            dberr << "Number of independent variables cannot be "
+                     "larger than 65535." << std::endl;
+            state.status = TERMINATED;
+            return state;
+        }
+
+        // As usual for L-BFGS, a small number of correction pairs suffices
+        state.initialize(*this, static_cast<uint16_t>(x.size()), 10);
+        if (!args[3].isNull()) {
+            LogRegrLBFGSTransitionState<ArrayHandle<double> > previousState = args[3];
+
+            state = previousState;
+            state.reset();
+        }
+    }
+
+    // Now do the transition step
+    state.numRows++;
+    double xc = dot(x, state.trialCoef);
+    state.gradNew.noalias() += sigma(-y * xc) * y * trans(x);
+
+    //          n
+    //         --
+    // l(c) = -\  log(1 + exp(-y_i * c^T x_i))
+    //         /_
+    //         i=1
+    state.logLikelihoodNew -= std::log( 1. + std::exp(-y * xc) );
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logregr_lbfgs_step_merge_states::run(AnyType &args) {
+    LogRegrLBFGSTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    LogRegrLBFGSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the logistic-regression final step
+ *
+ * The trial point is accepted if it satisfies the Armijo condition. In that
+ * case, a new correction pair is stored and the next search direction is
+ * computed with the two-loop recursion. Otherwise, the step size is reduced
+ * by quadratic interpolation and the next iteration evaluates a new trial
+ * point on the same search direction.
+ */
+AnyType
+logregr_lbfgs_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    LogRegrLBFGSTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    if (!state.gradNew.is_finite()) {
+        dberr << "Over- or underflow in L-BFGS step, while computing the "
+                 "gradient. Input data is likely of poor numerical condition."
+              << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    // sufficient-increase constant of the Armijo condition
+    const double c1 = 1e-4;
+    double slope = dot(state.grad, state.dir);
+    bool accept = state.iteration == 0
+        || (std::isfinite(static_cast<double>(state.logLikelihoodNew))
+            && state.logLikelihoodNew >= state.logLikelihood
+                + c1 * state.stepsize * slope);
+
+    if (!accept) {
+        state.accepted = 0;
+
+        // Backtrack: maximize the quadratic interpolating l(c) at
+        // stepsize 0 (value and slope) and at the rejected stepsize
+        double step = state.stepsize;
+        double newStep = 0.1 * step;
+        if (std::isfinite(static_cast<double>(state.logLikelihoodNew))) {
+            double curvature = state.logLikelihood + slope * step
+                - state.logLikelihoodNew;
+            if (curvature > 0)
+                newStep = std::min(0.5 * step,
+                    std::max(0.1 * step, slope * step * step / (2 * curvature)));
+        }
+
+        // No further progress is possible along this direction, so we are
+        // at the optimum up to rounding errors
+        if (newStep * state.dir.lpNorm<Eigen::Infinity>()
+                <= std::numeric_limits<double>::epsilon()
+                    * std::max(1., state.coef.lpNorm<Eigen::Infinity>())) {
+            state.accepted = 1;
+            state.trialCoef = state.coef;
+            state.iteration++;
+            return state;
+        }
+
+        state.stepsize = newStep;
+        state.trialCoef = state.coef + newStep * state.dir;
+        state.iteration++;
+        return state;
+    }
+
+    if (state.iteration > 0) {
+        // s_k = c_{k+1} - c_k, and y_k is the difference of the gradients of
+        // -l(c), which has a positive definite Hessian
+        ColumnVector s = state.trialCoef - state.coef;
+        ColumnVector y = state.grad - state.gradNew;
+
+        // Skip the pair if the curvature condition fails, so that the
+        // approximation stays positive definite
+        if (dot(s, y) > std::numeric_limits<double>::epsilon() * y.squaredNorm()) {
+            state.newestPair = static_cast<uint16_t>(
+                (state.newestPair + 1) % state.historySize);
+            state.S.col(state.newestPair) = s;
+            state.Y.col(state.newestPair) = y;
+            if (state.numPairs < state.historySize)
+                state.numPairs = static_cast<uint16_t>(state.numPairs + 1);
+        }
+    }
+
+    state.coef = state.trialCoef;
+    state.grad = state.gradNew;
+    state.logLikelihood = state.logLikelihoodNew;
+    state.accepted = 1;
+
+    state.dir = state.inverseHessianTimes(state.grad);
+    if (state.numPairs == 0 || !(dot(state.grad, state.dir) > 0)) {
+        // Restart with a gradient step of unit length
+        state.numPairs = 0;
+        state.dir = state.grad;
+        double norm = state.grad.norm();
+        state.stepsize = norm > 0 ? 1. / norm : 0.;
+    } else
+        state.stepsize = 1.;
+    state.trialCoef = state.coef + state.stepsize * state.dir;
+
+    if (!state.trialCoef.is_finite()) {
+        dberr << "Over- or underflow in L-BFGS step, while updating "
+                 "coefficients. Input data is likely of poor numerical "
+                 "condition." << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    state.iteration++;
+    return state;
+}
+
+/**
+ * @brief Return the difference in log-likelihood between two states
+ *
+ * While the line search is still looking for an acceptable step, the
+ * log-likelihood does not change, so we must not report convergence.
+ */
+AnyType
+internal_logregr_lbfgs_step_distance::run(AnyType &args) {
+    LogRegrLBFGSTransitionState<ArrayHandle<double> > stateLeft = args[0];
+    LogRegrLBFGSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.accepted == 0)
+        return std::numeric_limits<double>::infinity();
+    return std::abs(stateLeft.logLikelihood - stateRight.logLikelihood);
+}
+
+/**
+ * @brief Perform the transition step of the final L-BFGS pass
+ *
+ * The L-BFGS approximation of the inverse Hessian only reflects the last few
+ * steps, so it cannot be used for the standard errors. After convergence, one
+ * more scan accumulates the exact \f$ X^T A X \f$ and log-likelihood at the
+ * final coefficients. The state is that of the IRLS step, so that its merge
+ * function can be reused.
+ */
+AnyType
+logregr_lbfgs_result_transition::run(AnyType &args) {
+    LogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+    if (args[3].isNull())
+        return state;
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    MappedColumnVector x = args[2].getAs<MappedColumnVector>();
+
+    if (!x.is_finite()){
+        dberr << "Design matrix is not finite." << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    if (state.numRows == 0) {
+        LogRegrLBFGSTransitionState<ArrayHandle<double> > lbfgsState = args[3];
+
+        state.initialize(*this, lbfgsState.widthOfX);
+        state.coef = lbfgsState.coef;
+        state.status = lbfgsState.status;
+    }
+
+    state.numRows++;
+    double xc = dot(x, state.coef);
+    double a = sigma(xc) * sigma(-xc);
+    packedRankUpdate(state.X_transp_AX, x, a);
+    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    return state;
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the final
+ *     L-BFGS pass
+ */
+AnyType
+logregr_lbfgs_result_final::run(AnyType &args) {
+    LogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    // See MADLIB-138
+    if (!state.X_transp_AX.is_finite()) {
+        dberr << "Over- or underflow in intermediate calulation. Input data "
+                 "is likely of poor numerical condition." << std::endl;
+        ColumnVector undefined = ColumnVector::Constant(state.widthOfX,
+            std::numeric_limits<double>::quiet_NaN());
+        return stateToResult(*this, state.coef, undefined,
+            state.logLikelihood, std::numeric_limits<double>::quiet_NaN(),
+            TERMINATED);
+    }
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        unpackSymmetric(state.X_transp_AX, state.widthOfX),
+        EigenvaluesOnly, ComputePseudoInverse);
+
+    return stateToResult(*this, state.coef,
+        decomposition.pseudoInverse().diagonal(), state.logLikelihood,
+        decomposition.conditionNo(), state.status);
+}
+
 /**
  * @brief Compute the diagnostic statistics
  *
@@ -1223,17 +1715,17 @@ robust_logregr_step_transition::run(AnyType &args) {
 	// Now do the transition step
     state.numRows++;
 	double xc = dot(x, coef);
-   	ColumnVector Grad;
-   	Grad = sigma(-y * xc) * y * trans(x);
 
-	Matrix GradGradTranspose;
-	GradGradTranspose = Grad*Grad.transpose();
-	state.meat += GradGradTranspose;
+    ScratchArena& scratch = args.getScratchArena();
+    scratch.reset();
+    MutableMappedColumnVector Grad = scratch.columnVector(x.size());
+    Grad = sigma(-y * xc) * y * x;
+    state.meat.noalias() += Grad * trans(Grad);
 
 	// Note: sigma(-x) = 1 - sigma(x).
     // a_i = sigma(x_i c) sigma(-x_i c)
     double a = sigma(xc) * sigma(-xc);
-    triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+    state.X_transp_AX.selfadjointView<Eigen::Lower>().rankUpdate(x, a);
 	return state;
 }
 
@@ -1517,7 +2009,12 @@ marginal_logregr_step_transition::run(AnyType &args) {
   // TODO: Change the average code so it won't overflow
   state.marginal_effects_per_observation += G_xc * (1 - G_xc);
   state.X_bar += x;
-  state.X_transp_AX += x * trans(x) * a;
+
+  ScratchArena& scratch = args.getScratchArena();
+  scratch.reset();
+  MutableMappedColumnVector ax = scratch.columnVector(x.size());
+  ax = a * x;
+  state.X_transp_AX.noalias() += ax * trans(x);
 
 	return state;
 
@@ -1589,6 +2086,373 @@ marginal_logregr_step_final::run(AnyType &args) {
 
 
 
+// ---------------------------------------------------------------------------
+//             Cross-Validation Logistic Regression States
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief Inter- and intra-iteration state of the iteratively-reweighted-
+ *        least-squares method for all folds of a cross validation
+ *
+ * The state holds one model per fold. Model k is trained on the rows that
+ * are not in fold k, and validated on the rows of fold k, so that every row
+ * updates all models in the same scan.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 4, and all elemenets are 0.
+ */
+template <class Handle>
+class LogRegrCVTransitionState {
+    template <class OtherHandle>
+    friend class LogRegrCVTransitionState;
+
+public:
+    LogRegrCVTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[0]),
+            static_cast<uint16_t>(mStorage[1]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the state.
+     *
+     * This function is only called for the first iteration, for the first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inFoldNum,
+        uint16_t inWidthOfX) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inFoldNum, inWidthOfX));
+        rebind(inFoldNum, inWidthOfX);
+        foldNum = inFoldNum;
+        widthOfX = inWidthOfX;
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    LogRegrCVTransitionState &operator=(
+        const LogRegrCVTransitionState<OtherHandle> &inOtherState) {
+
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another State object by copying the intra-iteration
+     *     fields
+     */
+    template <class OtherHandle>
+    LogRegrCVTransitionState &operator+=(
+        const LogRegrCVTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            foldNum != inOtherState.foldNum ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        X_transp_Az += inOtherState.X_transp_Az;
+        X_transp_AX += inOtherState.X_transp_AX;
+        logLikelihood += inOtherState.logLikelihood;
+        validRows += inOtherState.validRows;
+        validCorrect += inOtherState.validCorrect;
+        validLogLikelihood += inOtherState.validLogLikelihood;
+        // merged state should have the higher status
+        // (see top of file for more on 'status' )
+        status = (inOtherState.status > status) ? inOtherState.status : status;
+        return *this;
+    }
+
+    /**
+     * @brief Reset the inter-iteration fields.
+     */
+    inline void reset() {
+        numRows = 0;
+        X_transp_Az.fill(0);
+        X_transp_AX.fill(0);
+        logLikelihood.fill(0);
+        validRows.fill(0);
+        validCorrect.fill(0);
+        validLogLikelihood.fill(0);
+        status = IN_PROCESS;
+    }
+
+    /**
+     * @brief Update the packed X^T A X of model k
+     */
+    template <class Derived>
+    inline void rankUpdate(Index k, const Eigen::MatrixBase<Derived> &x,
+        double a) {
+
+        typename HandleTraits<Handle>::MatrixTransparentHandleMap::ColXpr
+            packed = X_transp_AX.col(k);
+        packedRankUpdate(packed, x, a);
+    }
+
+private:
+    static inline uint32_t arraySize(const uint16_t inFoldNum,
+        const uint16_t inWidthOfX) {
+
+        return static_cast<uint32_t>(4 + (2 * inWidthOfX
+            + packedTriangleSize(inWidthOfX) + 4) * inFoldNum);
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inFoldNum The number of folds, i.e., of models.
+     * @param inWidthOfX The number of independent variables.
+     *
+     * Array layout (iteration refers to one aggregate-function call), where
+     * every matrix has one column and every vector one element per fold:
+     * Inter-iteration components (updated in final function):
+     * - 0: foldNum (number of folds)
+     * - 1: widthOfX (number of coefficients)
+     * - 2: coef (widthOfX x foldNum matrix of coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 2 + widthOfX * foldNum: numRows (number of rows already processed in
+     *   this iteration)
+     * - 3 + widthOfX * foldNum: X_transp_Az (X^T A z)
+     * - 3 + 2 * widthOfX * foldNum: X_transp_AX (X^T A X, packed lower
+     *   triangles of size T = widthOfX * (widthOfX + 1) / 2)
+     * - 3 + (2 * widthOfX + T) * foldNum: logLikelihood ( ln(l(c)) on the
+     *   training rows)
+     * - 3 + (2 * widthOfX + T + 1) * foldNum: validRows (number of
+     *   validation rows)
+     * - 3 + (2 * widthOfX + T + 2) * foldNum: validCorrect (number of
+     *   correctly classified validation rows)
+     * - 3 + (2 * widthOfX + T + 3) * foldNum: validLogLikelihood
+     *   ( ln(l(c)) on the validation rows)
+     * - 3 + (2 * widthOfX + T + 4) * foldNum: status
+     */
+    void rebind(uint16_t inFoldNum, uint16_t inWidthOfX) {
+        const uint32_t K = inFoldNum;
+        const uint32_t p = inWidthOfX;
+        const uint32_t T = static_cast<uint32_t>(
+            packedTriangleSize(inWidthOfX));
+
+        foldNum.rebind(&mStorage[0]);
+        widthOfX.rebind(&mStorage[1]);
+        coef.rebind(&mStorage[2], p, K);
+        numRows.rebind(&mStorage[2 + p * K]);
+        X_transp_Az.rebind(&mStorage[3 + p * K], p, K);
+        X_transp_AX.rebind(&mStorage[3 + 2 * p * K], T, K);
+        logLikelihood.rebind(&mStorage[3 + (2 * p + T) * K], K);
+        validRows.rebind(&mStorage[3 + (2 * p + T + 1) * K], K);
+        validCorrect.rebind(&mStorage[3 + (2 * p + T + 2) * K], K);
+        validLogLikelihood.rebind(&mStorage[3 + (2 * p + T + 3) * K], K);
+        status.rebind(&mStorage[3 + (2 * p + T + 4) * K]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 foldNum;
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap coef;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_Az;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap logLikelihood;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap validRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap validCorrect;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap validLogLikelihood;
+    typename HandleTraits<Handle>::ReferenceToUInt16 status;
+};
+
+/**
+ * @brief Perform the cross-validation transition step
+ *
+ * A row of fold f is a training row of every model k != f, and a validation
+ * row of model f, which is evaluated with the coefficients of the current
+ * iteration.
+ */
+AnyType
+logregr_cv_irls_step_transition::run(AnyType &args) {
+    LogRegrCVTransitionState<MutableArrayHandle<double> > state = args[0];
+    int fold = args[1].getAs<int>();
+    bool yIsTrue = args[2].getAs<bool>();
+    double y = yIsTrue ? 1. : -1.;
+    MappedColumnVector x = args[3].getAs<MappedColumnVector>();
+
+    if (!x.is_finite()){
+        dberr << "Design matrix is not finite." << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max()){
+            dberr << "Number of independent variables cannot be "
+                     "larger than 65535." << std::endl;
+            state.status = TERMINATED;
+            return state;
+        }
+
+        int foldNum = args[4].getAs<int>();
+        if (foldNum < 2 || foldNum > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of folds must be between 2 and "
+                "65535.");
+
+        state.initialize(*this, static_cast<uint16_t>(foldNum),
+            static_cast<uint16_t>(x.size()));
+        if (!args[5].isNull()) {
+            LogRegrCVTransitionState<ArrayHandle<double> > previousState = args[5];
+
+            state = previousState;
+            state.reset();
+        }
+    }
+
+    if (fold < 0 || fold >= state.foldNum)
+        throw std::domain_error("Fold number is out of range.");
+
+    // Now do the transition step
+    state.numRows++;
+    for (Index k = 0; k < state.foldNum; k++) {
+        double xc = dot(x, state.coef.col(k));
+        double logLikelihood = - std::log( 1. + std::exp(-y * xc) );
+
+        if (k == fold) {
+            state.validRows(k) += 1;
+            if ((xc > 0) == yIsTrue)
+                state.validCorrect(k) += 1;
+            state.validLogLikelihood(k) += logLikelihood;
+            continue;
+        }
+
+        // See logregr_irls_step_transition
+        double a = sigma(xc) * sigma(-xc);
+        double az = xc * a + sigma(-y * xc) * y;
+
+        state.X_transp_Az.col(k).noalias() += x * az;
+        state.rankUpdate(k, x, a);
+        state.logLikelihood(k) += logLikelihood;
+    }
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logregr_cv_irls_step_merge_states::run(AnyType &args) {
+    LogRegrCVTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    LogRegrCVTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the cross-validation final step: one Newton step per model
+ */
+AnyType
+logregr_cv_irls_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    LogRegrCVTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    // See MADLIB-138
+    if (!state.X_transp_AX.is_finite() || !state.X_transp_Az.is_finite()){
+        dberr   << "Over- or underflow in intermediate"
+                    " calulation. Input data is likely of poor"
+                    " numerical condition."
+                << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    for (Index k = 0; k < state.foldNum; k++) {
+        SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+            unpackSymmetric(state.X_transp_AX.col(k), state.widthOfX),
+            EigenvaluesOnly, ComputePseudoInverse);
+
+        state.coef.col(k).noalias() =
+            decomposition.pseudoInverse() * state.X_transp_Az.col(k);
+    }
+
+    if (!state.coef.is_finite()){
+        dberr   << "Overflow or underflow in"
+                    " Newton step. while updating coefficients."
+                    " Input data is likely of poor numerical condition."
+                << std::endl;
+        state.status = TERMINATED;
+        return state;
+    }
+
+    return state;
+}
+
+/**
+ * @brief Return the largest difference in training log-likelihood of any
+ *     model between two states
+ */
+AnyType
+internal_logregr_cv_irls_step_distance::run(AnyType &args) {
+    LogRegrCVTransitionState<ArrayHandle<double> > stateLeft = args[0];
+    LogRegrCVTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    ColumnVector difference = stateLeft.logLikelihood
+        - stateRight.logLikelihood;
+    return difference.lpNorm<Eigen::Infinity>();
+}
+
+/**
+ * @brief Return the validation accuracy and log-likelihood of every fold
+ *
+ * The log-likelihood is the average over the rows of the validation fold.
+ */
+AnyType
+internal_logregr_cv_irls_result::run(AnyType &args) {
+    LogRegrCVTransitionState<ArrayHandle<double> > state = args[0];
+
+    for (Index k = 0; k < state.foldNum; k++)
+        if (state.validRows(k) == 0)
+            throw std::domain_error("Too few data! At least one fold is "
+                "empty.");
+
+    ColumnVector accuracy = state.validCorrect.cwiseQuotient(state.validRows);
+    ColumnVector logLikelihood =
+        state.validLogLikelihood.cwiseQuotient(state.validRows);
+
+    AnyType tuple;
+    tuple << accuracy << logLikelihood << static_cast<int>(state.status);
+    return tuple;
+}
+
+
+
 } // namespace regress
 
 } // namespace modules
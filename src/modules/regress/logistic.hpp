@@ -90,6 +90,39 @@ DECLARE_UDF(regress, internal_logregr_igd_step_distance)
  */
 DECLARE_UDF(regress, internal_logregr_igd_result)
 
+/**
+ * @brief Logistic regression (limited-memory BFGS step): Transition function
+ */
+DECLARE_UDF(regress, logregr_lbfgs_step_transition)
+
+/**
+ * @brief Logistic regression (limited-memory BFGS step): State merge function
+ */
+DECLARE_UDF(regress, logregr_lbfgs_step_merge_states)
+
+/**
+ * @brief Logistic regression (limited-memory BFGS step): Final function
+ */
+DECLARE_UDF(regress, logregr_lbfgs_step_final)
+
+/**
+ * @brief Logistic regression (limited-memory BFGS step): Difference in
+ *     log-likelihood between two transition states
+ */
+DECLARE_UDF(regress, internal_logregr_lbfgs_step_distance)
+
+/**
+ * @brief Logistic regression (limited-memory BFGS result): Transition
+ *     function of the exact \f$ X^T A X \f$ pass at the final coefficients
+ */
+DECLARE_UDF(regress, logregr_lbfgs_result_transition)
+
+/**
+ * @brief Logistic regression (limited-memory BFGS result): Final function,
+ *     which converts the state to the result tuple
+ */
+DECLARE_UDF(regress, logregr_lbfgs_result_final)
+
 /**
  * @brief Robust Variance Logistic regression step: Transition function
  */
@@ -121,3 +154,33 @@ DECLARE_UDF(regress, marginal_logregr_step_merge_states)
  */
 DECLARE_UDF(regress, marginal_logregr_step_final)
 
+
+/**
+ * @brief Logistic regression cross validation (iteratively-reweighted-lest-
+ *     squares step for all folds): Transition function
+ */
+DECLARE_UDF(regress, logregr_cv_irls_step_transition)
+
+/**
+ * @brief Logistic regression cross validation (iteratively-reweighted-lest-
+ *     squares step for all folds): State merge function
+ */
+DECLARE_UDF(regress, logregr_cv_irls_step_merge_states)
+
+/**
+ * @brief Logistic regression cross validation (iteratively-reweighted-lest-
+ *     squares step for all folds): Final function
+ */
+DECLARE_UDF(regress, logregr_cv_irls_step_final)
+
+/**
+ * @brief Logistic regression cross validation: Largest difference in
+ *     log-likelihood between two transition states
+ */
+DECLARE_UDF(regress, internal_logregr_cv_irls_step_distance)
+
+/**
+ * @brief Logistic regression cross validation: Convert transition state to
+ *     per-fold validation result
+ */
+DECLARE_UDF(regress, internal_logregr_cv_irls_result)
@@ -48,6 +48,81 @@ inline double sigma(double x) {
     return 1. / (1. + std::exp(-x));
 }
 
+/**
+ * @brief Return v = vec(pi * x^T), allocated in the scratch arena
+ */
+template <class Vector>
+inline MutableMappedColumnVector
+multilogisticKroneckerVector(const Vector &x, const ColumnVector &pi,
+    ScratchArena &scratch) {
+
+    const Index numCategories = pi.size();
+    MutableMappedColumnVector v = scratch.columnVector(numCategories * x.size());
+    for (Index i = 0; i < x.size(); i++)
+        v.segment(i * numCategories, numCategories) = x(i) * pi;
+    return v;
+}
+
+/**
+ * @brief Add the contribution of one row to the lower triangle of X^T A X
+ *
+ * The Hessian is indexed feature-major (row i*J + j belongs to feature i and
+ * category j), so that the J x J block (i1, i2) of the row contribution is
+ * x(i1) * x(i2) * (pi * pi^T - diag(pi)). Instead of materializing this
+ * (J*p) x (J*p) Kronecker product, we split it into
+ * - the rank-1 term v * v^T with v = vec(pi * x^T), and
+ * - the block-diagonal term x * x^T (x) diag(pi), which only touches entries
+ *   where both categories coincide.
+ *
+ * Both are added directly to the state, so no temporaries of the size of
+ * the Hessian are needed. The vector v is taken from the scratch arena.
+ */
+template <class Hessian, class Vector>
+inline void
+multilogisticHessianUpdate(Hessian &hessian, const Vector &x,
+    const ColumnVector &pi, ScratchArena &scratch) {
+
+    const Index numCategories = pi.size();
+    const Index widthOfX = x.size();
+
+    hessian.template selfadjointView<Eigen::Lower>().rankUpdate(
+        multilogisticKroneckerVector(x, pi, scratch));
+
+    for (Index i2 = 0; i2 < widthOfX; i2++) {
+        for (Index i1 = i2; i1 < widthOfX; i1++) {
+            const double xx = x(i1) * x(i2);
+            for (Index j = 0; j < numCategories; j++)
+                hessian(i1 * numCategories + j, i2 * numCategories + j)
+                    -= xx * pi(j);
+        }
+    }
+}
+
+/**
+ * @brief Same as multilogisticHessianUpdate(), but for a Hessian stored as
+ *     packed lower triangle (see packedRankUpdate())
+ */
+template <class PackedHessian, class Vector>
+inline void
+multilogisticPackedHessianUpdate(PackedHessian &hessian, const Vector &x,
+    const ColumnVector &pi, ScratchArena &scratch) {
+
+    const Index numCategories = pi.size();
+    const Index widthOfX = x.size();
+    const Index n = numCategories * widthOfX;
+
+    packedRankUpdate(hessian, multilogisticKroneckerVector(x, pi, scratch));
+
+    for (Index i2 = 0; i2 < widthOfX; i2++) {
+        for (Index i1 = i2; i1 < widthOfX; i1++) {
+            const double xx = x(i1) * x(i2);
+            for (Index j = 0; j < numCategories; j++)
+                hessian(packedIndex(n, i1 * numCategories + j,
+                    i2 * numCategories + j)) -= xx * pi(j);
+        }
+    }
+}
+
 
 /**
  * @brief Inter- and intra-iteration state for iteratively-reweighted-least-
@@ -147,8 +222,9 @@ public:
 private:
     static inline uint32_t arraySize(const uint16_t inWidthOfX,
         const uint16_t inNumCategories) {
-        return 5 + inWidthOfX * inWidthOfX * inNumCategories * inNumCategories
-                                 + 2 * inWidthOfX * inNumCategories;
+        return static_cast<uint32_t>(5
+            + packedTriangleSize(inWidthOfX * inNumCategories)
+            + 2 * inWidthOfX * inNumCategories);
     }
 
     /**
@@ -167,13 +243,19 @@ private:
      * Intra-iteration components (updated in transition step):
      * - 2 + widthOfX*numCategories: numRows (number of rows already processed in this iteration)
      * - 3 + widthOfX*numCategories: gradient (X^T A z)
-     * - 3 + 2 * widthOfX * inNumCategories: X_transp_AX (X^T A X)
-     * - 3 + widthOfX^2*numCategories^2
-                         + 2 * widthOfX*numCategories: logLikelihood ( ln(l(c)) )
-     * - 4 + widthOfX^2*numCategories^2
-                         + 2 * widthOfX*numCategories: ref_category
+     * - 3 + 2 * widthOfX * inNumCategories: X_transp_AX (X^T A X, packed
+                         lower triangle of size T = n * (n + 1) / 2 where
+                         n = widthOfX * numCategories)
+     * - 3 + T + 2 * widthOfX*numCategories: logLikelihood ( ln(l(c)) )
+     * - 4 + T + 2 * widthOfX*numCategories: ref_category
+     *
+     * X^T A X is symmetric, so storing only one triangle halves the state
+     * that has to be shipped between segments in every merge.
      */
     void rebind(uint16_t inWidthOfX = 0, uint16_t inNumCategories = 0) {
+        const uint32_t T = static_cast<uint32_t>(
+            packedTriangleSize(inWidthOfX * inNumCategories));
+
         widthOfX.rebind(&mStorage[0]);
         numCategories.rebind(&mStorage[1]);
         coef.rebind(&mStorage[2], inWidthOfX*inNumCategories);
@@ -181,13 +263,10 @@ private:
         numRows.rebind(&mStorage[2 + inWidthOfX*inNumCategories]);
 
         gradient.rebind(&mStorage[3 + inWidthOfX*inNumCategories],inWidthOfX*inNumCategories);
-        X_transp_AX.rebind(&mStorage[3 + 2 * inWidthOfX*inNumCategories],
-            inNumCategories*inWidthOfX, inWidthOfX*inNumCategories);
-        logLikelihood.rebind(&mStorage[3 +
-             inNumCategories*inNumCategories*inWidthOfX*inWidthOfX
+        X_transp_AX.rebind(&mStorage[3 + 2 * inWidthOfX*inNumCategories], T);
+        logLikelihood.rebind(&mStorage[3 + T
              + 2 * inWidthOfX*inNumCategories]);
-        ref_category.rebind(&mStorage[4 +
-             inNumCategories*inNumCategories*inWidthOfX*inWidthOfX
+        ref_category.rebind(&mStorage[4 + T
              + 2 * inWidthOfX*inNumCategories]);
     }
 
@@ -200,7 +279,7 @@ public:
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
     typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap gradient;
-    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap X_transp_AX;
     typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
     typename HandleTraits<Handle>::ReferenceToUInt16 ref_category;
 };
@@ -454,41 +533,13 @@ __mlogregr_irls_step_transition::run(AnyType &args) {
     //We cast the gradient into a vector to make the Newton step calculations much easier.
     grad.resize(numCategories*state.widthOfX,1);
 
-    /*
-         a is a matrix of size JxJ where J is the number of categories
-         a_j1j2 = -pi(j1)*(1-pi(j2))if j1 == j2
-         a_j1j2 =  pi(j1)*pi(j2) if j1 != j2
-    */
-    Matrix a(numCategories,numCategories);
-    // Compute the 'a' matrix.
-    Matrix piDiag = pi.asDiagonal();
-    a = pi * pi.transpose() - piDiag;
     state.gradient.noalias() += grad;
 
-    //Start the Hessian calculations
-    Matrix X_transp_AX(numCategories * state.widthOfX, numCategories * state.widthOfX);
-
-    /*
-        Again: The following 3 lines could have been written as
-        Matrix XXTrans = x * x.transpose();
-        but it creates warnings related to the type of x. Here is an easy fix
-    */
-    Matrix cv_x = x;
-    Matrix XXTrans = trans(cv_x);
-    XXTrans = cv_x * XXTrans;
-
-    //Eigen doesn't supported outer-products for matrices, so we have to do our own.
-    //This operation is also known as a tensor-product.
-    for (int i1 = 0; i1 < state.widthOfX; i1++){
-         for (int i2 = 0; i2 <state.widthOfX; i2++){
-            int rowOffset = numCategories * i1;
-            int colOffset = numCategories * i2;
-
-            X_transp_AX.block(rowOffset, colOffset, numCategories,  numCategories) = XXTrans(i1,i2)*a;
-        }
-    }
-
-    triangularView<Lower>(state.X_transp_AX) += X_transp_AX;
+    // Hessian contribution of this row: the J x J blocks x(i1) * x(i2) *
+    // (pi * pi^T - diag(pi)) are added in place
+    ScratchArena& scratch = args.getScratchArena();
+    scratch.reset();
+    multilogisticPackedHessianUpdate(state.X_transp_AX, x, pi, scratch);
 
     state.logLikelihood += y.transpose()*t1 - log(t3);
 
@@ -538,7 +589,8 @@ __mlogregr_irls_step_final::run(AnyType &args) {
             "calulation. Input data is likely of poor numerical condition.");
 
     SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        -1 * state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        -1 * unpackSymmetric(state.X_transp_AX, state.gradient.size()),
+        EigenvaluesOnly, ComputePseudoInverse);
 
     // Precompute (X^T * A * X)^-1
     Matrix heissianInver = -1 * decomposition.pseudoInverse();
@@ -555,7 +607,7 @@ __mlogregr_irls_step_final::run(AnyType &args) {
     // Likewise, we store the condition number.
     // FIXME: This feels a bit like a hack.
     state.gradient = -1 * heissianInver.diagonal();
-    state.X_transp_AX(0,0) = decomposition.conditionNo();
+    state.X_transp_AX(0) = decomposition.conditionNo();
 
     return state;
 }
@@ -643,44 +695,13 @@ mlogregr_robust_step_transition::run(AnyType &args) {
     //We cast the gradient into a vector to make the math easier.
     grad.resize(numCategories * state.widthOfX, 1);
 
-    Matrix GradGradTranspose;
-    GradGradTranspose = grad * grad.transpose();
-	state.meat += GradGradTranspose;
-
-    /*
-         a is a matrix of size JxJ where J is the number of categories
-         a_j1j2 = -pi(j1)*(1-pi(j2))if j1 == j2
-         a_j1j2 =  pi(j1)*pi(j2) if j1 != j2
-    */
-    // Compute the 'a' matrix.
-    Matrix a(numCategories,numCategories);
-    Matrix piDiag = pi.asDiagonal();
-    a = pi * pi.transpose() - piDiag;
-
-    //Start the Hessian calculations
-    Matrix X_transp_AX(numCategories * state.widthOfX, numCategories * state.widthOfX);
-
-    /*
-        Again: The following 3 lines could have been written as
-        Matrix XXTrans = x * x.transpose();
-        but it creates warnings related to the type of x. Here is an easy fix
-    */
-    Matrix cv_x = x;
-    Matrix XXTrans = trans(cv_x);
-    XXTrans = cv_x * XXTrans;
-
-    //Eigen doesn't supported outer-products for matrices, so we have to do our own.
-    //This operation is also known as a tensor-product.
-    for (int i1 = 0; i1 < state.widthOfX; i1++){
-         for (int i2 = 0; i2 <state.widthOfX; i2++){
-            int rowOffset = numCategories * i1;
-            int colOffset = numCategories * i2;
-
-            X_transp_AX.block(rowOffset, colOffset, numCategories,  numCategories) = XXTrans(i1, i2) * a;
-        }
-    }
+    state.meat.noalias() += grad * grad.transpose();
 
-    triangularView<Lower>(state.X_transp_AX) += X_transp_AX;
+    // Hessian contribution of this row: the J x J blocks x(i1) * x(i2) *
+    // (pi * pi^T - diag(pi)) are added in place
+    ScratchArena& scratch = args.getScratchArena();
+    scratch.reset();
+    multilogisticHessianUpdate(state.X_transp_AX, x, pi, scratch);
 
     return state;
 
@@ -800,7 +821,7 @@ __internal_mlogregr_irls_result::run(AnyType &args) {
     MLogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
 
     return mLogstateToResult(*this, state.ref_category, state.coef,
-        state.gradient, state.logLikelihood, state.X_transp_AX(0,0));
+        state.gradient, state.logLikelihood, state.X_transp_AX(0));
 }
 
 
@@ -1089,38 +1110,12 @@ mlogregr_marginal_step_transition::run(AnyType &args) {
 
     //    Variance Calculations
     // ----------------------------------------------------------------------
-    /*
-         a is a matrix of size JxJ where J is the number of categories
-         a_j1j2 = -pi(j1)*(1-pi(j2))if j1 == j2
-         a_j1j2 =  pi(j1)*pi(j2) if j1 != j2
-    */
-    Matrix a(numCategories,numCategories);
-    a = prob * prob.transpose() - probDiag;
-
-    // Start the Hessian calculations
-    Matrix X_transp_AX(numCategories * state.widthOfX, numCategories * state.widthOfX);
-
-    /*
-        Again: The following 3 lines could have been written as
-        Matrix XXTrans = x * x.transpose();
-        but it creates warnings related to the type of x. Here is an easy fix
-    */
-    Matrix cv_x = x;
-    Matrix XXTrans = trans(cv_x);
-    XXTrans = cv_x * XXTrans;
-
-    //Eigen doesn't supported outer-products for matrices, so we have to do our own.
-    //This operation is also known as a tensor-product.
-    for (int i1 = 0; i1 < state.widthOfX; i1++){
-         for (int i2 = 0; i2 <state.widthOfX; i2++){
-            int rowOffset = numCategories * i1;
-            int colOffset = numCategories * i2;
-
-            X_transp_AX.block(rowOffset, colOffset, numCategories,  numCategories) = XXTrans(i1, i2) * a;
-        }
-    }
+    // Hessian contribution of this row: the J x J blocks x(i1) * x(i2) *
+    // (pi * pi^T - diag(pi)) are added in place
+    ScratchArena& scratch = args.getScratchArena();
+    scratch.reset();
+    multilogisticHessianUpdate(state.X_transp_AX, x, prob, scratch);
 
-    triangularView<Lower>(state.X_transp_AX) += X_transp_AX;
     state.margins_matrix += margins_matrix;
     state.reference_margins += -coef_trans_prob * ref_prob; 
     state.X_bar += x; // It is called X_bar but it really is the sum
@@ -9,6 +9,8 @@
 
 #include <boost/tr1/random.hpp>
 
+#include <cmath>
+
 // Import TR1 names (currently used from boost). This can go away once we make
 // the switch to C++11.
 namespace std {
@@ -153,6 +155,246 @@ WeightedSampleAccumulator<Container, T>::operator=(
     return *this;
 }
 
+template <class Container, class T>
+inline
+WeightedReservoirAccumulator<Container, T>::WeightedReservoirAccumulator(
+    Init_type& inInitialization)
+  : Base(inInitialization) {
+
+    this->initialize();
+}
+
+/**
+ * @brief Bind all elements of the state to the data in the stream
+ */
+template <class Container, class T>
+inline
+void
+WeightedReservoirAccumulator<Container, T>::bind(ByteStream_type& inStream) {
+    inStream >> k >> numSamples >> width;
+    for (int i = 0; i < 4; ++i)
+        inStream >> rngState[i];
+
+    uint32_t actualK = k.isNull() ? 0 : static_cast<uint32_t>(k);
+    uint32_t actualWidth = width.isNull() ? 0 : static_cast<uint32_t>(width);
+    inStream
+        >> weightToSkip
+        >> logKeys.rebind(actualK)
+        >> Samples_traits::rebind(samples, actualWidth, actualK);
+}
+
+inline
+uint32_t
+reservoirSampleWidth(const int64_t&) {
+    return 0;
+}
+
+inline
+uint32_t
+reservoirSampleWidth(const MappedColumnVector& inX) {
+    return static_cast<uint32_t>(inX.size());
+}
+
+template <class Samples>
+inline
+void
+storeReservoirSample(Samples& ioSamples, Index inPos, const int64_t& inX) {
+    ioSamples(0, inPos) = inX;
+}
+
+template <class Samples>
+inline
+void
+storeReservoirSample(Samples& ioSamples, Index inPos,
+    const MappedColumnVector& inX) {
+
+    ioSamples.col(inPos) = inX;
+}
+
+/**
+ * @brief Set the sample size and dimension, and seed the random number engine
+ *
+ * The backend generator is called only here, once per aggregate state.
+ */
+template <class Container, class T>
+inline
+void
+WeightedReservoirAccumulator<Container, T>::initializeReservoir(
+    const T& inX, uint32_t inK) {
+
+    if (inK == 0)
+        throw std::invalid_argument("Sample size must be positive.");
+
+    k = inK;
+    numSamples = 0;
+    width = reservoirSampleWidth(inX);
+    this->resize();
+
+    NativeRandomNumberGenerator nativeGenerator;
+    uint64_t seed
+        = (static_cast<uint64_t>(nativeGenerator() * 4294967296.) << 32)
+        ^ static_cast<uint64_t>(nativeGenerator() * 4294967296.);
+    storeGenerator(utils::Xoshiro256StarStar(seed));
+    weightToSkip = 0;
+}
+
+template <class Container, class T>
+inline
+void
+WeightedReservoirAccumulator<Container, T>::insert(Index inPos,
+    const T& inX, double inLogKey) {
+
+    logKeys(inPos) = inLogKey;
+    storeReservoirSample(samples, inPos, inX);
+}
+
+/**
+ * @brief Draw the total weight of rows to skip before the next insertion
+ *
+ * With T the smallest key in the (full) reservoir, the skipped weight is
+ * log(r) / log(T) for r uniform in (0, 1).
+ */
+template <class Container, class T>
+inline
+void
+WeightedReservoirAccumulator<Container, T>::drawJump(
+    utils::Xoshiro256StarStar& ioGenerator) {
+
+    weightToSkip = std::log(ioGenerator.uniformOpen()) / logKeys.minCoeff();
+}
+
+template <class Container, class T>
+inline
+utils::Xoshiro256StarStar
+WeightedReservoirAccumulator<Container, T>::loadGenerator() const {
+    return utils::Xoshiro256StarStar(
+        static_cast<uint64_t>(rngState[0]), static_cast<uint64_t>(rngState[1]),
+        static_cast<uint64_t>(rngState[2]), static_cast<uint64_t>(rngState[3]));
+}
+
+template <class Container, class T>
+inline
+void
+WeightedReservoirAccumulator<Container, T>::storeGenerator(
+    const utils::Xoshiro256StarStar& inGenerator) {
+
+    for (int i = 0; i < 4; ++i)
+        rngState[i] = inGenerator.state()[i];
+}
+
+/**
+ * @brief Update the accumulation state
+ */
+template <class Container, class T>
+inline
+WeightedReservoirAccumulator<Container, T>&
+WeightedReservoirAccumulator<Container, T>::operator<<(
+    const tuple_type& inTuple) {
+
+    const T& x = std::get<0>(inTuple);
+    const double& weight = std::get<1>(inTuple);
+    const uint32_t& sampleSize = std::get<2>(inTuple);
+
+    // As for the single weighted sample, rows with a non-positive weight are
+    // ignored
+    if (!(weight > 0.))
+        return *this;
+
+    if (k == 0)
+        initializeReservoir(x, sampleSize);
+    else if (sampleSize != static_cast<uint32_t>(k))
+        throw std::invalid_argument("Sample size must not change between "
+            "rows.");
+    else if (reservoirSampleWidth(x) != static_cast<uint32_t>(width))
+        throw std::invalid_argument("Inconsistent dimensions of sample "
+            "vectors.");
+
+    utils::Xoshiro256StarStar generator = loadGenerator();
+    uint32_t n = numSamples;
+    if (n < static_cast<uint32_t>(k)) {
+        insert(n, x, std::log(generator.uniformOpen()) / weight);
+        numSamples = ++n;
+        if (n == static_cast<uint32_t>(k))
+            drawJump(generator);
+    } else {
+        weightToSkip -= weight;
+        if (weightToSkip <= 0.) {
+            // The new key is drawn conditioned on exceeding the current
+            // threshold: r uniform in (T^w, 1), key = r^(1/w)
+            Index minPos;
+            double logThreshold = logKeys.minCoeff(&minPos);
+            double thresholdPow = std::exp(weight * logThreshold);
+            double r = thresholdPow
+                + (1. - thresholdPow) * generator.uniformOpen();
+            insert(minPos, x, std::log(r) / weight);
+            drawJump(generator);
+        }
+    }
+    storeGenerator(generator);
+
+    return *this;
+}
+
+/**
+ * @brief Merge with another accumulation state
+ *
+ * The merged reservoir consists of the k samples with the largest keys.
+ * Since the jumps are exponentially distributed (and therefore memoryless),
+ * a new jump is simply drawn for the merged reservoir.
+ */
+template <class Container, class T>
+template <class OtherContainer>
+inline
+WeightedReservoirAccumulator<Container, T>&
+WeightedReservoirAccumulator<Container, T>::operator<<(
+    const WeightedReservoirAccumulator<OtherContainer, T>& inOther) {
+
+    if (inOther.k == 0)
+        return *this;
+
+    // Initialize if necessary
+    if (k == 0) {
+        *this = inOther;
+        return *this;
+    }
+
+    if (static_cast<uint32_t>(k) != static_cast<uint32_t>(inOther.k)
+        || static_cast<uint32_t>(width) != static_cast<uint32_t>(inOther.width))
+        throw std::invalid_argument("Inconsistent sample sizes or dimensions "
+            "of sample vectors.");
+
+    uint32_t n = numSamples;
+    for (Index i = 0; i < static_cast<Index>(inOther.numSamples); ++i) {
+        Index pos = n;
+        if (n < static_cast<uint32_t>(k))
+            ++n;
+        else if (inOther.logKeys(i) <= logKeys.minCoeff(&pos))
+            continue;
+
+        logKeys(pos) = inOther.logKeys(i);
+        samples.col(pos) = inOther.samples.col(i);
+    }
+    numSamples = n;
+
+    if (n == static_cast<uint32_t>(k)) {
+        utils::Xoshiro256StarStar generator = loadGenerator();
+        drawJump(generator);
+        storeGenerator(generator);
+    }
+    return *this;
+}
+
+template <class Container, class T>
+template <class OtherContainer>
+inline
+WeightedReservoirAccumulator<Container, T>&
+WeightedReservoirAccumulator<Container, T>::operator=(
+    const WeightedReservoirAccumulator<OtherContainer, T>& inOther) {
+
+    this->copy(inOther);
+    return *this;
+}
+
 } // namespace sample
 
 } // namespace modules
@@ -7,6 +7,8 @@
 #ifndef MADLIB_MODULES_SAMPLE_WEIGHTED_SAMPLE_PROTO_HPP
 #define MADLIB_MODULES_SAMPLE_WEIGHTED_SAMPLE_PROTO_HPP
 
+#include <utils/Xoshiro256.hpp>
+
 namespace madlib {
 
 namespace modules {
@@ -47,6 +49,84 @@ public:
     typename DynamicStructType<T, isMutable>::type sample;
 };
 
+/**
+ * @brief Storage for the reservoir of a WeightedReservoirAccumulator
+ *
+ * Samples are stored as a matrix with one column per sample. For samples of
+ * type int64_t, this matrix has a single row.
+ */
+template <class T, bool IsMutable>
+struct WeightedReservoirSamples { };
+
+template <bool IsMutable>
+struct WeightedReservoirSamples<int64_t, IsMutable> {
+    typedef Eigen::Matrix<int64_t, Eigen::Dynamic, Eigen::Dynamic> Int64Matrix;
+    typedef HandleMap<
+        typename boost::mpl::if_c<IsMutable,
+            Int64Matrix, const Int64Matrix>::type,
+        TransparentHandle<int64_t, IsMutable> > type;
+
+    static type& rebind(type& ioSamples, uint32_t, uint32_t inK) {
+        return ioSamples.rebind(1, inK);
+    }
+};
+
+template <bool IsMutable>
+struct WeightedReservoirSamples<MappedColumnVector, IsMutable> {
+    typedef typename DynamicStructType<Matrix, IsMutable>::type type;
+
+    static type& rebind(type& ioSamples, uint32_t inWidth, uint32_t inK) {
+        return ioSamples.rebind(inWidth, inK);
+    }
+};
+
+/**
+ * @brief Weighted random sample of fixed size k without replacement
+ *
+ * Implements algorithm A-ExpJ of Efraimidis and Spirakis: Every row gets the
+ * key u^(1/w), and the k rows with the largest keys form the sample. Instead
+ * of drawing a random number for every row, A-ExpJ draws an exponential jump,
+ * i.e., the total weight of the rows that will not enter the reservoir before
+ * the next insertion. Keys are kept in log space to avoid underflow for small
+ * weights. Random numbers come from an in-process xoshiro256** engine whose
+ * state is part of the transition state. It is seeded once from the backend
+ * generator, so results are reproducible with setseed().
+ */
+template <class Container, class T>
+class WeightedReservoirAccumulator
+  : public DynamicStruct<WeightedReservoirAccumulator<Container, T>,
+        Container> {
+
+public:
+    typedef DynamicStruct<WeightedReservoirAccumulator, Container> Base;
+    MADLIB_DYNAMIC_STRUCT_TYPEDEFS;
+    typedef std::tuple<T, double, uint32_t> tuple_type;
+    typedef WeightedReservoirSamples<T, isMutable> Samples_traits;
+
+    WeightedReservoirAccumulator(Init_type& inInitialization);
+    void bind(ByteStream_type& inStream);
+    WeightedReservoirAccumulator& operator<<(const tuple_type& inTuple);
+    template <class OtherContainer> WeightedReservoirAccumulator& operator<<(
+        const WeightedReservoirAccumulator<OtherContainer, T>& inOther);
+    template <class OtherContainer> WeightedReservoirAccumulator& operator=(
+        const WeightedReservoirAccumulator<OtherContainer, T>& inOther);
+
+    uint32_type k;
+    uint32_type numSamples;
+    uint32_type width;
+    uint64_type rngState[4];
+    double_type weightToSkip;
+    ColumnVector_type logKeys;
+    typename Samples_traits::type samples;
+
+private:
+    void initializeReservoir(const T& inX, uint32_t inK);
+    void insert(Index inPos, const T& inX, double inLogKey);
+    void drawJump(utils::Xoshiro256StarStar& ioGenerator);
+    utils::Xoshiro256StarStar loadGenerator() const;
+    void storeGenerator(const utils::Xoshiro256StarStar& inGenerator);
+};
+
 } // namespace sample
 
 } // namespace modules
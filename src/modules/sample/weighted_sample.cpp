@@ -2,7 +2,7 @@
  *
  * @file weighted_sample.cpp
  *
- * @brief Generate a single weighted random sample
+ * @brief Generate weighted random samples
  *
  *//* ----------------------------------------------------------------------- */
 
@@ -28,6 +28,16 @@ typedef WeightedSampleAccumulator<RootContainer, MappedColumnVector>
 typedef WeightedSampleAccumulator<MutableRootContainer, MappedColumnVector>
     MutableWeightedSampleColVecState;
 
+typedef WeightedReservoirAccumulator<RootContainer, int64_t>
+    WeightedReservoirInt64State;
+typedef WeightedReservoirAccumulator<MutableRootContainer, int64_t>
+    MutableWeightedReservoirInt64State;
+
+typedef WeightedReservoirAccumulator<RootContainer, MappedColumnVector>
+    WeightedReservoirColVecState;
+typedef WeightedReservoirAccumulator<MutableRootContainer, MappedColumnVector>
+    MutableWeightedReservoirColVecState;
+
 
 /**
  * @brief Perform the weighted-sample transition step
@@ -95,6 +105,96 @@ weighted_sample_final_vector::run(AnyType &args) {
     return state.sample;
 }
 
+/**
+ * @brief Perform the transition step of the fixed-size weighted sample
+ */
+AnyType
+weighted_sample_k_transition_int64::run(AnyType& args) {
+    MutableWeightedReservoirInt64State state
+        = args[0].getAs<MutableByteString>();
+    int64_t x = args[1].getAs<int64_t>();
+    double weight = args[2].getAs<double>();
+    int32_t k = args[3].getAs<int32_t>();
+
+    if (k <= 0)
+        throw std::invalid_argument("Sample size must be positive.");
+
+    state << WeightedReservoirInt64State::tuple_type(x, weight,
+        static_cast<uint32_t>(k));
+    return state.storage();
+}
+
+AnyType
+weighted_sample_k_transition_vector::run(AnyType& args) {
+    MutableWeightedReservoirColVecState state
+        = args[0].getAs<MutableByteString>();
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    double weight = args[2].getAs<double>();
+    int32_t k = args[3].getAs<int32_t>();
+
+    if (k <= 0)
+        throw std::invalid_argument("Sample size must be positive.");
+
+    state << WeightedReservoirColVecState::tuple_type(x, weight,
+        static_cast<uint32_t>(k));
+    return state.storage();
+}
+
+/**
+ * @brief Perform the merging of two fixed-size weighted-sample states
+ */
+AnyType
+weighted_sample_k_merge_int64::run(AnyType &args) {
+    MutableWeightedReservoirInt64State stateLeft
+        = args[0].getAs<MutableByteString>();
+    WeightedReservoirInt64State stateRight = args[1].getAs<ByteString>();
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+AnyType
+weighted_sample_k_merge_vector::run(AnyType &args) {
+    MutableWeightedReservoirColVecState stateLeft
+        = args[0].getAs<MutableByteString>();
+    WeightedReservoirColVecState stateRight = args[1].getAs<ByteString>();
+
+    stateLeft << stateRight;
+    return stateLeft.storage();
+}
+
+/**
+ * @brief Perform the final step of the fixed-size weighted sample
+ *
+ * If there were fewer than k rows with positive weight, all of them are
+ * returned.
+ */
+AnyType
+weighted_sample_k_final_int64::run(AnyType &args) {
+    WeightedReservoirInt64State state = args[0].getAs<MutableByteString>();
+    uint32_t n = state.numSamples;
+    if (n == 0)
+        return Null();
+
+    MutableArrayHandle<int64_t> result = allocateArray<int64_t,
+        dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(n);
+    for (uint32_t i = 0; i < n; ++i)
+        result[i] = state.samples(0, i);
+    return result;
+}
+
+AnyType
+weighted_sample_k_final_vector::run(AnyType &args) {
+    WeightedReservoirColVecState state = args[0].getAs<MutableByteString>();
+    uint32_t n = state.numSamples;
+    if (n == 0)
+        return Null();
+
+    // Each column is one sample, so the result has one row per sample
+    Matrix result = state.samples.leftCols(n);
+    return result;
+}
+
 } // namespace sample
 
 } // namespace modules
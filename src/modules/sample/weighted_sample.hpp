@@ -21,3 +21,21 @@ DECLARE_UDF(sample, weighted_sample_merge_vector)
  */
 DECLARE_UDF(sample, weighted_sample_final_int64)
 DECLARE_UDF(sample, weighted_sample_final_vector)
+
+/**
+ * @brief Fixed-size weighted random sample: Transition function
+ */
+DECLARE_UDF(sample, weighted_sample_k_transition_int64)
+DECLARE_UDF(sample, weighted_sample_k_transition_vector)
+
+/**
+ * @brief Fixed-size weighted random sample: State merge function
+ */
+DECLARE_UDF(sample, weighted_sample_k_merge_int64)
+DECLARE_UDF(sample, weighted_sample_k_merge_vector)
+
+/**
+ * @brief Fixed-size weighted random sample: Final function
+ */
+DECLARE_UDF(sample, weighted_sample_k_final_int64)
+DECLARE_UDF(sample, weighted_sample_k_final_vector)
@@ -0,0 +1,282 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file correlation.cpp
+ *
+ * @brief Covariance and correlation matrix of the columns of a relation
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "correlation.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace stats {
+
+/**
+ * @brief Transition state for the covariance and correlation matrix
+ *
+ * The state holds the number of rows, the column means and the co-moment
+ * matrix \f$ C = \sum_i (x_i - \bar x)(x_i - \bar x)^T \f$ of the rows seen so
+ * far (only the lower triangle of C is maintained). Both are updated with the
+ * numerically stable formulas of Chan, Golub, and LeVeque, so that no large
+ * sums of squares are ever subtracted from each other.
+ *
+ * Rows are not added one by one. They are collected in a buffer of
+ * BlockSize rows first, and each full buffer is centered at its own mean and
+ * added to C with a single symmetric rank-k update. States of different
+ * segments are merged with the same formulas.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 4, and all elements are 0. (One more than the size of
+ * the header, so that the maps of the empty state can still be bound.)
+ */
+template <class Handle>
+class CorrelationTransitionState {
+    template <class OtherHandle>
+    friend class CorrelationTransitionState;
+
+public:
+    enum { BlockSize = 32 };
+
+    CorrelationTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the state.
+     *
+     * This function is only called for the first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inWidthOfX) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inWidthOfX));
+        rebind(inWidthOfX);
+        widthOfX = inWidthOfX;
+    }
+
+    /**
+     * @brief Append a row to the buffer, and fold the buffer if it is full
+     */
+    template <class Derived>
+    void operator<<(const Eigen::MatrixBase<Derived> &inX) {
+        buffer.col(static_cast<Index>(numBuffered)) = inX;
+        numBuffered++;
+        if (numBuffered == static_cast<uint32_t>(BlockSize))
+            flush();
+    }
+
+    /**
+     * @brief Fold the buffered rows into the means and the co-moment matrix
+     */
+    void flush() {
+        if (numBuffered == 0)
+            return;
+
+        Index k = static_cast<Index>(numBuffered);
+        ColumnVector blockMean = buffer.leftCols(k).rowwise().sum()
+            / static_cast<double>(k);
+        buffer.leftCols(k).colwise() -= blockMean;
+        coMoment.template selfadjointView<Eigen::Lower>().rankUpdate(
+            buffer.leftCols(k));
+        combine(numBuffered, blockMean);
+        numBuffered = 0;
+    }
+
+    /**
+     * @brief Merge with another State object
+     *
+     * The other state is read-only, so its buffered rows are copied into our
+     * buffer.
+     */
+    template <class OtherHandle>
+    CorrelationTransitionState &operator+=(
+        const CorrelationTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        flush();
+        if (inOtherState.numRows > 0) {
+            coMoment += inOtherState.coMoment;
+            combine(inOtherState.numRows, inOtherState.mean);
+        }
+        Index k = static_cast<Index>(inOtherState.numBuffered);
+        buffer.leftCols(k) = inOtherState.buffer.leftCols(k);
+        numBuffered = inOtherState.numBuffered;
+        flush();
+        return *this;
+    }
+
+private:
+    static inline uint64_t arraySize(const uint32_t inWidthOfX) {
+        return 3 + static_cast<uint64_t>(inWidthOfX)
+            * (1 + inWidthOfX + BlockSize);
+    }
+
+    /**
+     * @brief Combine with the statistics of a disjoint set of rows, given the
+     *     number of rows and their mean
+     *
+     * The co-moment matrix of the other rows must have been added to coMoment
+     * already.
+     */
+    template <class Derived>
+    void combine(uint64_t inNumRows, const Eigen::MatrixBase<Derived> &inMean) {
+        double n_a = static_cast<double>(numRows);
+        double n_b = static_cast<double>(inNumRows);
+        double n = n_a + n_b;
+        ColumnVector delta = inMean - mean;
+
+        coMoment.template selfadjointView<Eigen::Lower>().rankUpdate(
+            delta, n_a * n_b / n);
+        mean += delta * (n_b / n);
+        numRows += inNumRows;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of columns
+     *
+     * Array layout:
+     * - 0: widthOfX (number of columns)
+     * - 1: numRows (number of rows folded into mean and coMoment)
+     * - 2: numBuffered (number of rows in the buffer)
+     * - 3: mean (column means)
+     * - 3 + widthOfX: coMoment (co-moment matrix, lower triangle)
+     * - 3 + widthOfX * (1 + widthOfX): buffer (widthOfX x BlockSize, one row
+     *   of the input per column)
+     */
+    void rebind(uint32_t inWidthOfX) {
+        widthOfX.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        numBuffered.rebind(&mStorage[2]);
+        mean.rebind(&mStorage[3], inWidthOfX);
+        coMoment.rebind(&mStorage[3 + inWidthOfX], inWidthOfX, inWidthOfX);
+        buffer.rebind(&mStorage[3 + static_cast<uint64_t>(inWidthOfX)
+            * (1 + inWidthOfX)], inWidthOfX, BlockSize);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numBuffered;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap mean;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap coMoment;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap buffer;
+};
+
+/**
+ * @brief Perform the covariance and correlation transition step
+ */
+AnyType
+correlation_transition::run(AnyType &args) {
+    CorrelationTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+
+    if (state.widthOfX == 0) {
+        if (x.size() > std::numeric_limits<uint32_t>::max())
+            throw std::domain_error("Number of columns is too large.");
+        state.initialize(*this, static_cast<uint32_t>(x.size()));
+    } else if (x.size() != static_cast<Index>(state.widthOfX)) {
+        throw std::invalid_argument("Inconsistent number of columns. "
+            "Arrays of all rows must have the same length.");
+    }
+
+    state << x;
+    return state;
+}
+
+/**
+ * @brief Perform the covariance and correlation merge step
+ */
+AnyType
+correlation_merge_states::run(AnyType &args) {
+    CorrelationTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    CorrelationTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.widthOfX == 0)
+        return stateRight;
+    else if (stateRight.widthOfX == 0)
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the covariance and correlation final step
+ *
+ * Besides the covariance matrix, the sample standard deviations of the
+ * columns are returned as a vector, so that callers do not need to extract
+ * the diagonal. Correlations involving a constant column are NaN. As with
+ * corr(), the result is Null if fewer than two rows have been seen.
+ */
+AnyType
+correlation_final::run(AnyType &args) {
+    CorrelationTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.widthOfX == 0)
+        return Null();
+
+    state.flush();
+
+    // The sample covariance of a single row is undefined
+    if (state.numRows < 2)
+        return Null();
+
+    Matrix covariance = state.coMoment.selfadjointView<Eigen::Lower>();
+    covariance /= static_cast<double>(state.numRows) - 1.;
+
+    ColumnVector stdDev = covariance.diagonal().cwiseSqrt();
+    Matrix correlation = stdDev.cwiseInverse().asDiagonal() * covariance
+        * stdDev.cwiseInverse().asDiagonal();
+    for (Index i = 0; i < stdDev.size(); i++)
+        if (stdDev(i) == 0) {
+            correlation.row(i).fill(std::numeric_limits<double>::quiet_NaN());
+            correlation.col(i).fill(std::numeric_limits<double>::quiet_NaN());
+        }
+
+    AnyType tuple;
+    tuple << static_cast<int64_t>(state.numRows)
+          << state.mean
+          << stdDev
+          << covariance
+          << correlation;
+    return tuple;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file correlation.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Covariance and correlation matrix: Transition function
+ */
+DECLARE_UDF(stats, correlation_transition)
+
+/**
+ * @brief Covariance and correlation matrix: State merge function
+ */
+DECLARE_UDF(stats, correlation_merge_states)
+
+/**
+ * @brief Covariance and correlation matrix: Final function
+ */
+DECLARE_UDF(stats, correlation_final)
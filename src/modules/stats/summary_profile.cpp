@@ -0,0 +1,622 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file summary_profile.cpp
+ *
+ * @brief Fused per-column statistics for the summary function
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "summary_profile.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace stats {
+
+namespace {
+
+// HyperLogLog distinct-count sketch: 2^12 registers of 6 bits per column,
+// eight of which are packed into one double (48 bits, so the packed value is
+// an exact integer)
+const int kDistinctPrecision = 12;
+const uint32_t kDistinctRegisters = 1U << kDistinctPrecision;
+const int kRegisterBits = 6;
+const uint32_t kRegistersPerWord = 8;
+const Index kDistinctWords = kDistinctRegisters / kRegistersPerWord;
+
+// Quantile sketch: counts of the values in logarithmic buckets
+// (gamma^(k-1), gamma^k], which makes all quantiles accurate up to a relative
+// error of kQuantileAccuracy. Positive and negative values are kept in
+// separate stores of kQuantileBins buckets each. A store is a window of
+// consecutive keys that moves with the data; if the keys span more than the
+// window, the smallest magnitudes are collapsed into the first bucket.
+const double kQuantileAccuracy = 0.01;
+const double kQuantileGamma
+    = (1 + kQuantileAccuracy) / (1 - kQuantileAccuracy);
+const int kQuantileBins = 1024;
+// Store layout: count, key of the first bucket, buckets
+const Index kQuantileStoreSize = 2 + kQuantileBins;
+// Sketch layout: number of zeros, store of negative values, store of positive
+// values
+const Index kQuantileWords = 1 + 2 * kQuantileStoreSize;
+
+uint32_t distinctRegister(const double *inWords, uint32_t inRegister);
+void setDistinctRegister(double *ioWords, uint32_t inRegister,
+    uint32_t inValue);
+void distinctSketchAdd(double *ioWords, double inHash);
+double distinctSketchEstimate(const double *inWords);
+void quantileSketchAdd(double *ioSketch, double inX);
+void quantileSketchMerge(double *ioSketch, const double *inOtherSketch);
+double quantileSketchValue(const double *inSketch, double inLevel,
+    double inMin, double inMax);
+
+} // anonymous namespace
+
+/**
+ * @brief Transition state for the per-column profile of summary()
+ *
+ * For each of the columns of a row, the state keeps the number of non-NULL
+ * values, their mean, the sum of squared deviations from the mean, and the
+ * minimum and maximum. Means and squared deviations are updated with
+ * Welford's method, and merged with the formulas of Chan, Golub, and LeVeque.
+ * All statistics of one kind are stored contiguously, so that the state of all
+ * columns is a single array.
+ *
+ * Optionally, the state also keeps a HyperLogLog sketch of the hash values of
+ * each column (for estimating the number of distinct values) and a quantile
+ * sketch of the values of each column (for estimating the quantile levels
+ * given with the first row). Both sketches are mergeable, so that they are
+ * computed in the same scan as the moments.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 5, and all elements are 0. (One more than the size of
+ * the header, so that the maps of the empty state can still be bound.)
+ */
+template <class Handle>
+class SummaryProfileTransitionState {
+    template <class OtherHandle>
+    friend class SummaryProfileTransitionState;
+
+public:
+    SummaryProfileTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]),
+            static_cast<uint32_t>(mStorage[2]), mStorage[3] != 0);
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the state.
+     *
+     * This function is only called for the first row.
+     */
+    inline void initialize(const Allocator &inAllocator, uint32_t inNumCols,
+        const ArrayHandle<double> &inLevels, bool inWithDistinct) {
+
+        uint32_t inNumLevels = static_cast<uint32_t>(inLevels.size());
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inNumCols, inNumLevels, inWithDistinct));
+        rebind(inNumCols, inNumLevels, inWithDistinct);
+        numCols = inNumCols;
+        numLevels = inNumLevels;
+        withDistinct = inWithDistinct;
+        for (uint32_t k = 0; k < inNumLevels; k++)
+            levels(k) = inLevels[k];
+    }
+
+    /**
+     * @brief Add a row, given its values, an indicator (0 or 1) of which
+     *     of them are not NULL, and (if distinct values are estimated) the
+     *     hash values of the columns
+     */
+    void add(const MappedColumnVector &inX,
+        const MappedColumnVector &inPresent,
+        const ArrayHandle<double> &inHashes) {
+
+        numRows++;
+        for (Index j = 0; j < inX.size(); j++) {
+            if (inPresent(j) == 0)
+                continue;
+
+            double x = inX(j);
+            double n = ++count(j);
+            double delta = x - mean(j);
+            mean(j) += delta / n;
+            sumSquaredDeviations(j) += delta * (x - mean(j));
+            if (n == 1 || x < min(j))
+                min(j) = x;
+            if (n == 1 || x > max(j))
+                max(j) = x;
+
+            if (withDistinct)
+                distinctSketchAdd(distinctSketch.col(j).data(), inHashes[j]);
+            if (numLevels > 0)
+                quantileSketchAdd(quantileSketch.col(j).data(), x);
+        }
+    }
+
+    /**
+     * @brief Merge with another State object
+     */
+    template <class OtherHandle>
+    SummaryProfileTransitionState &operator+=(
+        const SummaryProfileTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            numCols != inOtherState.numCols ||
+            numLevels != inOtherState.numLevels ||
+            withDistinct != inOtherState.withDistinct)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        for (Index j = 0; j < count.size(); j++) {
+            double n_b = inOtherState.count(j);
+            if (n_b == 0)
+                continue;
+
+            double n_a = count(j);
+            double n = n_a + n_b;
+            double delta = inOtherState.mean(j) - mean(j);
+            mean(j) += delta * (n_b / n);
+            sumSquaredDeviations(j) += inOtherState.sumSquaredDeviations(j)
+                + delta * delta * (n_a * n_b / n);
+            if (n_a == 0 || inOtherState.min(j) < min(j))
+                min(j) = inOtherState.min(j);
+            if (n_a == 0 || inOtherState.max(j) > max(j))
+                max(j) = inOtherState.max(j);
+            count(j) = n;
+
+            if (withDistinct) {
+                double *words = distinctSketch.col(j).data();
+                const double *otherWords
+                    = inOtherState.distinctSketch.col(j).data();
+                for (uint32_t r = 0; r < kDistinctRegisters; r++) {
+                    uint32_t value = distinctRegister(otherWords, r);
+                    if (value > distinctRegister(words, r))
+                        setDistinctRegister(words, r, value);
+                }
+            }
+            if (numLevels > 0)
+                quantileSketchMerge(quantileSketch.col(j).data(),
+                    inOtherState.quantileSketch.col(j).data());
+        }
+        return *this;
+    }
+
+private:
+    static inline uint64_t arraySize(const uint32_t inNumCols,
+        const uint32_t inNumLevels, const bool inWithDistinct) {
+
+        return 4 + static_cast<uint64_t>(inNumLevels)
+            + static_cast<uint64_t>(inNumCols) * (5
+                + (inWithDistinct ? kDistinctWords : 0)
+                + (inNumLevels > 0 ? kQuantileWords : 0));
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inNumCols The number of columns
+     * @param inNumLevels The number of quantile levels
+     * @param inWithDistinct Whether distinct values are estimated
+     *
+     * Array layout:
+     * - 0: numCols (number of columns)
+     * - 1: numRows (number of rows)
+     * - 2: numLevels (number of quantile levels, 0 if no quantile sketch)
+     * - 3: withDistinct (1 if there is a distinct-count sketch, 0 otherwise)
+     * - 4: levels (quantile levels)
+     * - 4 + numLevels: count (number of non-NULL values of each column)
+     * - 4 + numLevels + numCols: mean
+     * - 4 + numLevels + 2 * numCols: sumSquaredDeviations
+     * - 4 + numLevels + 3 * numCols: min
+     * - 4 + numLevels + 4 * numCols: max
+     * - 4 + numLevels + 5 * numCols: distinctSketch (if withDistinct)
+     * - followed by: quantileSketch (if numLevels > 0)
+     */
+    void rebind(uint32_t inNumCols, uint32_t inNumLevels,
+        bool inWithDistinct) {
+
+        uint64_t end = 4 + inNumLevels + 5 * static_cast<uint64_t>(inNumCols);
+
+        numCols.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        numLevels.rebind(&mStorage[2]);
+        withDistinct.rebind(&mStorage[3]);
+        levels.rebind(&mStorage[4], inNumLevels);
+        count.rebind(&mStorage[4 + inNumLevels], inNumCols);
+        mean.rebind(&mStorage[4 + inNumLevels + inNumCols], inNumCols);
+        sumSquaredDeviations.rebind(
+            &mStorage[4 + inNumLevels + 2 * inNumCols], inNumCols);
+        min.rebind(&mStorage[4 + inNumLevels + 3 * inNumCols], inNumCols);
+        max.rebind(&mStorage[4 + inNumLevels + 4 * inNumCols], inNumCols);
+        // The sketches may be empty, so they are bound by pointer arithmetic
+        // (which allows pointing past the end of the array)
+        distinctSketch.rebind(mStorage.ptr() + end, kDistinctWords,
+            inWithDistinct ? inNumCols : 0);
+        if (inWithDistinct)
+            end += kDistinctWords * static_cast<uint64_t>(inNumCols);
+        quantileSketch.rebind(mStorage.ptr() + end, kQuantileWords,
+            inNumLevels > 0 ? inNumCols : 0);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numCols;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numLevels;
+    typename HandleTraits<Handle>::ReferenceToBool withDistinct;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap levels;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap count;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap mean;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        sumSquaredDeviations;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap min;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap max;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap distinctSketch;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap quantileSketch;
+};
+
+/**
+ * @brief Perform the summary profile transition step
+ *
+ * The SQL interface passes NULL values as arbitrary numbers, together with an
+ * indicator array that is 0 for NULL and 1 otherwise. The hash values are
+ * only needed if distinct values are estimated, and the quantile levels only
+ * if quantiles are estimated; otherwise they are empty arrays. The quantile
+ * levels are taken from the first row.
+ */
+AnyType
+summary_profile_transition::run(AnyType &args) {
+    SummaryProfileTransitionState<MutableArrayHandle<double> > state = args[0];
+    MappedColumnVector x = args[1].getAs<MappedColumnVector>();
+    MappedColumnVector present = args[2].getAs<MappedColumnVector>();
+    ArrayHandle<double> hashes = args[3].getAs<ArrayHandle<double> >();
+
+    if (x.size() != present.size())
+        throw std::invalid_argument("Value and indicator arrays must have the "
+            "same length.");
+    if (hashes.size() != 0 && hashes.size() != static_cast<size_t>(x.size()))
+        throw std::invalid_argument("Hash array must be empty or have the "
+            "same length as the value array.");
+
+    if (state.numCols == 0) {
+        ArrayHandle<double> levels = args[4].getAs<ArrayHandle<double> >();
+
+        if (x.size() > std::numeric_limits<uint32_t>::max())
+            throw std::domain_error("Number of columns is too large.");
+        for (size_t k = 0; k < levels.size(); k++)
+            if (!(levels[k] >= 0 && levels[k] <= 1))
+                throw std::domain_error("Quantile levels must be in the "
+                    "range [0, 1].");
+        state.initialize(*this, static_cast<uint32_t>(x.size()), levels,
+            hashes.size() != 0);
+    } else if (x.size() != static_cast<Index>(state.numCols)) {
+        throw std::invalid_argument("Inconsistent number of columns. "
+            "Arrays of all rows must have the same length.");
+    } else if ((hashes.size() != 0) != state.withDistinct) {
+        throw std::invalid_argument("Inconsistent hash arrays. "
+            "Either all rows or none must have hash values.");
+    }
+
+    state.add(x, present, hashes);
+    return state;
+}
+
+/**
+ * @brief Perform the summary profile merge step
+ */
+AnyType
+summary_profile_merge_states::run(AnyType &args) {
+    SummaryProfileTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    SummaryProfileTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numCols == 0)
+        return stateRight;
+    else if (stateRight.numCols == 0)
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the summary profile final step
+ *
+ * Statistics that are undefined (e.g., the mean of a column with only NULL
+ * values, or the variance of a column with a single value) are NaN. The
+ * estimated quantiles of column j (0-based) for level k are at position
+ * j * numLevels + k. Sketches that were not computed are returned as NULL.
+ */
+AnyType
+summary_profile_final::run(AnyType &args) {
+    SummaryProfileTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numCols == 0)
+        return Null();
+
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    Index numCols = static_cast<Index>(state.numCols);
+    Index numLevels = static_cast<Index>(state.numLevels);
+    ColumnVector missing(numCols);
+    ColumnVector mean(numCols);
+    ColumnVector variance(numCols);
+    ColumnVector min(numCols);
+    ColumnVector max(numCols);
+    ColumnVector distinct(state.withDistinct ? numCols : 0);
+    ColumnVector quantiles(numCols * numLevels);
+
+    for (Index j = 0; j < numCols; j++) {
+        double n = state.count(j);
+        missing(j) = static_cast<double>(state.numRows) - n;
+        mean(j) = n > 0 ? state.mean(j) : nan;
+        variance(j) = n > 1 ? state.sumSquaredDeviations(j) / (n - 1) : nan;
+        min(j) = n > 0 ? state.min(j) : nan;
+        max(j) = n > 0 ? state.max(j) : nan;
+        if (state.withDistinct)
+            distinct(j) = n > 0 ? std::min(n,
+                distinctSketchEstimate(state.distinctSketch.col(j).data()))
+                : 0;
+        for (Index k = 0; k < numLevels; k++)
+            quantiles(j * numLevels + k) = n > 0
+                ? quantileSketchValue(state.quantileSketch.col(j).data(),
+                    state.levels(k), min(j), max(j))
+                : nan;
+    }
+
+    AnyType tuple;
+    tuple << static_cast<int64_t>(state.numRows)
+          << missing
+          << mean
+          << variance
+          << min
+          << max;
+    if (state.withDistinct)
+        tuple << distinct;
+    else
+        tuple << Null();
+    if (numLevels > 0)
+        tuple << quantiles;
+    else
+        tuple << Null();
+    return tuple;
+}
+
+namespace {
+
+inline
+uint32_t
+distinctRegister(const double *inWords, uint32_t inRegister) {
+    uint64_t word = static_cast<uint64_t>(
+        inWords[inRegister / kRegistersPerWord]);
+    return static_cast<uint32_t>(
+        (word >> (kRegisterBits * (inRegister % kRegistersPerWord))) & 0x3F);
+}
+
+inline
+void
+setDistinctRegister(double *ioWords, uint32_t inRegister, uint32_t inValue) {
+    double &wordRef = ioWords[inRegister / kRegistersPerWord];
+    int shift = kRegisterBits * (inRegister % kRegistersPerWord);
+    uint64_t word = static_cast<uint64_t>(wordRef);
+    word = (word & ~(static_cast<uint64_t>(0x3F) << shift))
+        | (static_cast<uint64_t>(inValue) << shift);
+    wordRef = static_cast<double>(word);
+}
+
+/**
+ * @brief Add a 32-bit hash value (as returned by hashtext) to a HyperLogLog
+ *     sketch
+ *
+ * The first kDistinctPrecision bits select the register, which keeps the
+ * maximum position of the first 1-bit in the remaining bits.
+ */
+void
+distinctSketchAdd(double *ioWords, double inHash) {
+    uint32_t hash = static_cast<uint32_t>(static_cast<int32_t>(inHash));
+    uint32_t reg = hash >> (32 - kDistinctPrecision);
+    uint32_t rest = hash << kDistinctPrecision;
+    uint32_t rank = 1;
+
+    while (rank <= 32 - kDistinctPrecision && (rest & 0x80000000U) == 0) {
+        rest <<= 1;
+        rank++;
+    }
+    if (rank > distinctRegister(ioWords, reg))
+        setDistinctRegister(ioWords, reg, rank);
+}
+
+/**
+ * @brief Estimate the number of distinct values from a HyperLogLog sketch
+ *
+ * This is the estimator of Flajolet et al., including the corrections for
+ * small cardinalities (linear counting) and for large cardinalities (hash
+ * collisions of the 32-bit hash values).
+ */
+double
+distinctSketchEstimate(const double *inWords) {
+    const double m = kDistinctRegisters;
+    const double twoTo32 = 4294967296.;
+    double sum = 0;
+    uint32_t numZeros = 0;
+
+    for (uint32_t r = 0; r < kDistinctRegisters; r++) {
+        uint32_t value = distinctRegister(inWords, r);
+        sum += std::ldexp(1., -static_cast<int>(value));
+        if (value == 0)
+            numZeros++;
+    }
+
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && numZeros > 0)
+        estimate = m * std::log(m / numZeros);
+    else if (estimate > twoTo32 / 30)
+        estimate = -twoTo32 * std::log(1 - estimate / twoTo32);
+    return std::floor(estimate + 0.5);
+}
+
+/**
+ * @brief Add a weight to the bucket of a key in a quantile store
+ */
+void
+quantileStoreAdd(double *ioStore, double inKey, double inWeight) {
+    double &storeCount = ioStore[0];
+    double &offset = ioStore[1];
+    double *bins = ioStore + 2;
+
+    if (storeCount == 0) {
+        offset = inKey - kQuantileBins / 2;
+    } else if (inKey < offset || inKey >= offset + kQuantileBins) {
+        // Move the window so that it holds all keys (centered), or else the
+        // largest keys
+        double lo = inKey;
+        double hi = inKey;
+        for (int i = 0; i < kQuantileBins; i++)
+            if (bins[i] != 0) {
+                lo = std::min(lo, offset + i);
+                break;
+            }
+        for (int i = kQuantileBins - 1; i >= 0; i--)
+            if (bins[i] != 0) {
+                hi = std::max(hi, offset + i);
+                break;
+            }
+        double newOffset = hi - lo < kQuantileBins
+            ? lo - std::floor((kQuantileBins - (hi - lo + 1)) / 2)
+            : hi - kQuantileBins + 1;
+
+        double shifted[kQuantileBins];
+        std::fill(shifted, shifted + kQuantileBins, 0.);
+        for (int i = 0; i < kQuantileBins; i++)
+            if (bins[i] != 0)
+                shifted[static_cast<int>(
+                    std::max(offset + i - newOffset, 0.))] += bins[i];
+        std::copy(shifted, shifted + kQuantileBins, bins);
+        offset = newOffset;
+    }
+    bins[static_cast<int>(std::max(inKey - offset, 0.))] += inWeight;
+    storeCount += inWeight;
+}
+
+/**
+ * @brief Add a value to a quantile sketch
+ *
+ * Values that are not finite are ignored.
+ */
+void
+quantileSketchAdd(double *ioSketch, double inX) {
+    if (!isfinite(inX))
+        return;
+
+    if (inX == 0) {
+        ioSketch[0] += 1;
+        return;
+    }
+    double key = std::ceil(std::log(std::fabs(inX)) / std::log(kQuantileGamma));
+    quantileStoreAdd(inX < 0 ? ioSketch + 1 : ioSketch + 1 + kQuantileStoreSize,
+        key, 1);
+}
+
+/**
+ * @brief Merge a quantile sketch into another
+ */
+void
+quantileSketchMerge(double *ioSketch, const double *inOtherSketch) {
+    ioSketch[0] += inOtherSketch[0];
+    for (int s = 0; s < 2; s++) {
+        double *store = ioSketch + 1 + s * kQuantileStoreSize;
+        const double *otherStore = inOtherSketch + 1 + s * kQuantileStoreSize;
+        if (otherStore[0] == 0)
+            continue;
+
+        for (int i = 0; i < kQuantileBins; i++)
+            if (otherStore[2 + i] != 0)
+                quantileStoreAdd(store, otherStore[1] + i, otherStore[2 + i]);
+    }
+}
+
+/**
+ * @brief Return the estimated quantile of the given level, clamped to the
+ *     exact minimum and maximum
+ *
+ * Like percentile_cont, the level q refers to the (q * (n - 1))-th smallest
+ * of the n values (0-based). The estimate for a bucket is the value of
+ * smallest relative error for all values in the bucket.
+ */
+double
+quantileSketchValue(const double *inSketch, double inLevel, double inMin,
+    double inMax) {
+
+    const double *negative = inSketch + 1;
+    const double *positive = inSketch + 1 + kQuantileStoreSize;
+    double n = inSketch[0] + negative[0] + positive[0];
+
+    if (inLevel <= 0 || n == 0)
+        return inMin;
+    if (inLevel >= 1)
+        return inMax;
+
+    double rank = inLevel * (n - 1);
+    double cumulative = 0;
+    double value = inMax;
+    bool found = false;
+
+    // Negative values in ascending order are the keys in descending order
+    for (int i = kQuantileBins - 1; !found && i >= 0; i--) {
+        cumulative += negative[2 + i];
+        if (negative[0] > 0 && cumulative > rank) {
+            value = -2 * std::pow(kQuantileGamma, negative[1] + i)
+                / (kQuantileGamma + 1);
+            found = true;
+        }
+    }
+    cumulative = negative[0];
+    if (!found && cumulative + inSketch[0] > rank) {
+        value = 0;
+        found = true;
+    }
+    cumulative += inSketch[0];
+    for (int i = 0; !found && i < kQuantileBins; i++) {
+        cumulative += positive[2 + i];
+        if (positive[0] > 0 && cumulative > rank) {
+            value = 2 * std::pow(kQuantileGamma, positive[1] + i)
+                / (kQuantileGamma + 1);
+            found = true;
+        }
+    }
+    return std::min(std::max(value, inMin), inMax);
+}
+
+} // anonymous namespace
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
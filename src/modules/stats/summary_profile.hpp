@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file summary_profile.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Per-column profile for summary(): Transition function
+ */
+DECLARE_UDF(stats, summary_profile_transition)
+
+/**
+ * @brief Per-column profile for summary(): State merge function
+ */
+DECLARE_UDF(stats, summary_profile_merge_states)
+
+/**
+ * @brief Per-column profile for summary(): Final function
+ */
+DECLARE_UDF(stats, summary_profile_final)
@@ -22,6 +22,9 @@ inline void AnyType::setUserFuncContext(void * user_fctx){
 inline MemoryContext AnyType::getCacheMemoryContext(){
     return this->mSysInfo->cacheContext;
 }
+inline ScratchArena& AnyType::getScratchArena(){
+    return *ScratchArena::get(this->mSysInfo);
+}
 
 inline
 AnyType::AnyType(FunctionCallInfo inFnCallInfo)
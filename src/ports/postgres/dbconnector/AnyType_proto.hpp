@@ -14,6 +14,7 @@ namespace dbconnector {
 namespace postgres {
 
 struct SystemInformation;
+class ScratchArena;
 
 /**
  * @brief Proxy for PostgreSQL objects
@@ -52,6 +53,7 @@ public:
     void * getUserFuncContext();
     void setUserFuncContext(void * user_fctx);
     MemoryContext getCacheMemoryContext();
+    ScratchArena& getScratchArena();
 protected:
     /**
      * @brief RAII class to temporarily change \c sLazyConversionToDatum
@@ -28,6 +28,9 @@ MADLIB_WRAP_PG_FUNC(
     void*, MemoryContextAllocZero, (MemoryContext context, Size size),
     (context, size))
 
+MADLIB_WRAP_VOID_PG_FUNC(
+    pfree, (void* pointer), (pointer))
+
 MADLIB_WRAP_PG_FUNC(
     char*, format_procedure, (Oid procedure_oid), (procedure_oid))
 
@@ -227,6 +227,11 @@ VectorToNativeArray(const Eigen::MatrixBase<Derived>& inVector) {
 
 /**
  * @brief Convert a native array to [Mutable]MappedMatrix
+ *
+ * Each row of the two-dimensional array becomes one column of the matrix. This
+ * is also how blocks of rows are passed to block transition functions: Column
+ * \f$ i \f$ of the matrix is then the \f$ i \f$-th row of the block. No data
+ * is copied unless a mutable clone is requested.
  */
 template <class MatrixType>
 MatrixType
@@ -235,7 +240,6 @@ NativeArrayToMappedMatrix(Datum inDatum, bool inNeedMutableClone) {
 
     ArrayType* array = reinterpret_cast<ArrayType*>(
         madlib_DatumGetArrayTypeP(inDatum));
-    size_t arraySize = ARR_DIMS(array)[0] * ARR_DIMS(array)[1];
 
     if (ARR_NDIM(array) != 2) {
         std::stringstream errorMsg;
@@ -243,8 +247,13 @@ NativeArrayToMappedMatrix(Datum inDatum, bool inNeedMutableClone) {
             "dimensional array but got " << ARR_NDIM(array)
             << " dimensions.";
         throw std::invalid_argument(errorMsg.str());
+    } else if (ARR_HASNULL(array)) {
+        throw std::invalid_argument("Invalid type conversion to matrix. "
+            "Array contains NULL values.");
     }
-        
+
+    size_t arraySize = ARR_DIMS(array)[0] * ARR_DIMS(array)[1];
+
     Scalar* origData = reinterpret_cast<Scalar*>(ARR_DATA_PTR(array));
     Scalar* data;
 
@@ -0,0 +1,152 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ScratchArena_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_SCRATCHARENA_IMPL_HPP
+#define MADLIB_POSTGRES_SCRATCHARENA_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Get (and create) the scratch arena of the current entry point
+ *
+ * The arena is allocated in the cache memory context, so it lives as long as
+ * the other cached system-catalog information.
+ */
+inline
+ScratchArena*
+ScratchArena::get(SystemInformation* inSysInfo) {
+    if (!inSysInfo->scratchArena) {
+        ScratchArena* arena = static_cast<ScratchArena*>(
+            madlib_MemoryContextAllocZero(
+                inSysInfo->cacheContext, sizeof(ScratchArena)));
+        arena->mContext = inSysInfo->cacheContext;
+        inSysInfo->scratchArena = arena;
+    }
+    return inSysInfo->scratchArena;
+}
+
+/**
+ * @brief Release everything handed out so far
+ *
+ * If the previous round needed more memory than the block provides, the block
+ * is replaced by a larger one here (and not during allocation), so that
+ * pointers handed out before remain valid until this call.
+ */
+inline
+void
+ScratchArena::reset() {
+    while (mOverflow) {
+        Overflow* next = mOverflow->next;
+        madlib_pfree(mOverflow);
+        mOverflow = next;
+    }
+
+    if (mPeak > mCapacity) {
+        if (mBlock)
+            madlib_pfree(mBlock);
+        mBlock = NULL;
+        mCapacity = 0;
+
+        // Leave some headroom, so that slowly growing usage does not lead to
+        // a reallocation in every round
+        size_t capacity = aligned(mPeak + mPeak / 2);
+        mBlock = static_cast<char*>(allocateInContext(capacity));
+        mCapacity = capacity;
+    }
+    mUsed = 0;
+}
+
+/**
+ * @brief Allocate uninitialized memory that is valid until the next reset()
+ */
+inline
+void*
+ScratchArena::allocate(size_t inSize) {
+    const size_t size = aligned(inSize);
+    void* ptr;
+
+    if (mUsed <= mCapacity && size <= mCapacity - mUsed) {
+        ptr = mBlock + mUsed;
+    } else {
+        const size_t headerSize = aligned(sizeof(Overflow));
+        Overflow* overflow = static_cast<Overflow*>(
+            allocateInContext(headerSize + size));
+        overflow->next = mOverflow;
+        mOverflow = overflow;
+        ptr = reinterpret_cast<char*>(overflow) + headerSize;
+    }
+
+    mUsed += size;
+    if (mUsed > mPeak)
+        mPeak = mUsed;
+    return ptr;
+}
+
+template <typename T>
+inline
+T*
+ScratchArena::allocateArray(size_t inNumElements) {
+    if (std::numeric_limits<size_t>::max() / sizeof(T) < inNumElements)
+        throw std::bad_alloc();
+
+    return static_cast<T*>(allocate(sizeof(T) * inNumElements));
+}
+
+/**
+ * @brief Uninitialized column vector that is valid until the next reset()
+ */
+inline
+dbal::eigen_integration::MutableMappedColumnVector
+ScratchArena::columnVector(dbal::eigen_integration::Index inSize) {
+    return dbal::eigen_integration::MutableMappedColumnVector(
+        TransparentHandle<double, dbal::Mutable>(
+            allocateArray<double>(static_cast<size_t>(inSize))),
+        inSize);
+}
+
+/**
+ * @brief Uninitialized matrix that is valid until the next reset()
+ */
+inline
+dbal::eigen_integration::MutableMappedMatrix
+ScratchArena::matrix(dbal::eigen_integration::Index inRows,
+    dbal::eigen_integration::Index inCols) {
+
+    return dbal::eigen_integration::MutableMappedMatrix(
+        TransparentHandle<double, dbal::Mutable>(
+            allocateArray<double>(static_cast<size_t>(inRows * inCols))),
+        inRows, inCols);
+}
+
+inline
+size_t
+ScratchArena::aligned(size_t inSize) {
+    if (inSize > std::numeric_limits<size_t>::max() - Alignment)
+        throw std::bad_alloc();
+
+    return (inSize + Alignment - 1) & ~static_cast<size_t>(Alignment - 1);
+}
+
+inline
+void*
+ScratchArena::allocateInContext(size_t inSize) {
+    void* ptr = madlib_MemoryContextAlloc(mContext, inSize);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_SCRATCHARENA_IMPL_HPP)
@@ -0,0 +1,111 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file ScratchArena_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_SCRATCHARENA_PROTO_HPP
+#define MADLIB_POSTGRES_SCRATCHARENA_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Reusable scratch memory for per-row temporaries
+ *
+ * Transition functions are called once per row, and every Eigen temporary
+ * they create ends up in <tt>operator new()</tt> and thus \c palloc()
+ * (see NewDelete.cpp). A ScratchArena instead hands out memory from a single
+ * block that lives in the cache memory context of the calling function, i.e.,
+ * as long as the current query. The typical pattern is:
+ *
+ * @code
+ * ScratchArena& scratch = args.getScratchArena();
+ * scratch.reset();
+ * MutableMappedColumnVector v = scratch.columnVector(n);
+ * @endcode
+ *
+ * Allocation is a pointer bump. Requests that do not fit into the current
+ * block are served by separate allocations, and the next reset() replaces
+ * the block by one that is large enough for the peak usage seen so far.
+ * Hence, after the first row, no further backend allocations take place.
+ *
+ * Memory handed out by the arena is uninitialized and only valid until the
+ * next reset(). There is one arena per entry point into the C++ AL (it is
+ * stored in SystemInformation), so functions called via FunctionHandle share
+ * the arena of their caller and must not reset it.
+ *
+ * @note
+ *     Like SystemInformation, this is a plain-old data (POD) type. It is
+ *     never destructed; we rely on the PostgreSQL garbage collector.
+ */
+class ScratchArena {
+public:
+    static ScratchArena* get(SystemInformation* inSysInfo);
+
+    void reset();
+    void* allocate(size_t inSize);
+
+    template <typename T>
+    T* allocateArray(size_t inNumElements);
+
+    dbal::eigen_integration::MutableMappedColumnVector columnVector(
+        dbal::eigen_integration::Index inSize);
+    dbal::eigen_integration::MutableMappedMatrix matrix(
+        dbal::eigen_integration::Index inRows,
+        dbal::eigen_integration::Index inCols);
+
+protected:
+    /**
+     * @brief Header of an allocation that did not fit into the block
+     */
+    struct Overflow {
+        Overflow* next;
+    };
+
+    enum { Alignment = 16 };
+
+    static size_t aligned(size_t inSize);
+    void* allocateInContext(size_t inSize);
+
+    /**
+     * Memory context of the block and of all overflow allocations
+     */
+    MemoryContext mContext;
+
+    /**
+     * Start of the current block (aligned)
+     */
+    char* mBlock;
+
+    /**
+     * Usable size of the current block
+     */
+    size_t mCapacity;
+
+    /**
+     * Number of bytes handed out since the last reset()
+     */
+    size_t mUsed;
+
+    /**
+     * Maximum of mUsed over all resets, including overflow allocations
+     */
+    size_t mPeak;
+
+    /**
+     * Allocations that did not fit into the block, freed in reset()
+     */
+    Overflow* mOverflow;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_SCRATCHARENA_PROTO_HPP)
@@ -15,6 +15,8 @@ namespace dbconnector {
 
 namespace postgres {
 
+class ScratchArena;
+
 /**
  * @brief Cached information about PostgreSQL types
  *
@@ -231,6 +233,12 @@ struct SystemInformation {
      */
     void *user_fctx;
 
+    /**
+     * Scratch memory for temporaries of the function, created on first use.
+     * See ScratchArena.
+     */
+    ScratchArena *scratchArena;
+
     static SystemInformation* get(FunctionCallInfo fcinfo);
     TypeInformation* typeInformation(Oid inTypeID);
     FunctionInformation* functionInformation(Oid inFuncID);
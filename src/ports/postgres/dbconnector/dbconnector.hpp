@@ -213,6 +213,7 @@ using dbconnector::postgres::FunctionHandle;
 using dbconnector::postgres::MutableArrayHandle;
 using dbconnector::postgres::MutableByteString;
 using dbconnector::postgres::NativeRandomNumberGenerator;
+using dbconnector::postgres::ScratchArena;
 using dbconnector::postgres::TransparentHandle;
 
 // Import MADlib functions into madlib namespace
@@ -243,6 +244,7 @@ using dbconnector::postgres::dberr;
 // FIXME: The following include should be further up. Currently dependent on
 // dbal_impl.hpp which depends on the memory allocator.
 #include "EigenIntegration_proto.hpp"
+#include "ScratchArena_proto.hpp"
 
 #include "Allocator_impl.hpp"
 #include "AnyType_impl.hpp"
@@ -252,6 +254,7 @@ using dbconnector::postgres::dberr;
 #include "FunctionHandle_impl.hpp"
 #include "NativeRandomNumberGenerator_impl.hpp"
 #include "OutputStreamBuffer_impl.hpp"
+#include "ScratchArena_impl.hpp"
 #include "TransparentHandle_impl.hpp"
 #include "TypeTraits_impl.hpp"
 #include "UDF_impl.hpp"
@@ -0,0 +1,108 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Xoshiro256.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_XOSHIRO256_HPP
+#define MADLIB_XOSHIRO256_HPP
+
+#include <limits>
+
+namespace madlib {
+
+namespace utils {
+
+/**
+ * @brief Small, fast in-process pseudo-random number engine (xoshiro256**)
+ *
+ * In contrast to dbconnector's NativeRandomNumberGenerator, which calls into
+ * the backend for every number, this engine keeps its state of four 64-bit
+ * words locally. That makes it suitable for per-row use in aggregates: The
+ * state can be stored in the transition state and restored on the next call,
+ * so that the backend generator is consulted only once (for seeding).
+ *
+ * The interface follows the uniform random number generator concept, so the
+ * engine can be used with the standard/TR1 distributions.
+ */
+class Xoshiro256StarStar {
+public:
+    typedef uint64_t result_type;
+
+    Xoshiro256StarStar(uint64_t inSeed = 0) {
+        seed(inSeed);
+    }
+
+    Xoshiro256StarStar(uint64_t inS0, uint64_t inS1, uint64_t inS2,
+        uint64_t inS3) {
+
+        mState[0] = inS0;
+        mState[1] = inS1;
+        mState[2] = inS2;
+        mState[3] = inS3;
+    }
+
+    /**
+     * @brief Initialize the state from a single 64-bit seed
+     *
+     * The state is expanded with splitmix64, which guarantees that the state
+     * is never all-zero.
+     */
+    void seed(uint64_t inSeed) {
+        for (int i = 0; i < 4; ++i) {
+            uint64_t z = (inSeed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            mState[i] = z ^ (z >> 31);
+        }
+    }
+
+    result_type min() const {
+        return 0;
+    }
+
+    result_type max() const {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        const uint64_t result = rotl(mState[1] * 5, 7) * 9;
+        const uint64_t t = mState[1] << 17;
+
+        mState[2] ^= mState[0];
+        mState[3] ^= mState[1];
+        mState[1] ^= mState[2];
+        mState[0] ^= mState[3];
+        mState[2] ^= t;
+        mState[3] = rotl(mState[3], 45);
+
+        return result;
+    }
+
+    /**
+     * @brief Return a uniform random number in the open interval (0, 1)
+     *
+     * The result is never 0, so it is safe to take the logarithm.
+     */
+    double uniformOpen() {
+        return (static_cast<double>((*this)() >> 11) + 0.5)
+            * (1.0 / 9007199254740992.0);
+    }
+
+    const uint64_t* state() const {
+        return mState;
+    }
+
+private:
+    static uint64_t rotl(uint64_t inX, int inK) {
+        return (inX << inK) | (inX >> (64 - inK));
+    }
+
+    uint64_t mState[4];
+};
+
+} // namespace utils
+
+} // namespace madlib
+
+#endif // defined(MADLIB_XOSHIRO256_HPP)